@@ -9,38 +9,100 @@
 #include <jaffarCommon/deserializers/contiguous.hpp>
 #include "Atari2600Controller.h"
 #include "inputParser.hpp"
+#include "transitionCache.hpp"
+#include <cstring>
 
 namespace libA2600Hawk
 {
 
+// Size of the console's work RAM (RIOT RAM, mapped at $80-$FF)
+#define _WORK_RAM_SIZE 128
+
 class EmuInstanceBase
 {
   public:
 
+  // How the state hash is computed:
+  // - metroHash: MetroHash128 of the whole work RAM, from scratch every time
+  // - zobristHash: XOR of one key per (address, value) of the work RAM, updated only for the bytes that changed since the last hash
+  // - zobristHashChecked: as zobristHash, but also recomputed from scratch every time, throwing if they differ
+  // All of them read the whole work RAM from the core first, so the incremental update saves hashing work but not core reads
+  enum stateHashMode_t { metroHash, zobristHash, zobristHashChecked };
+
   EmuInstanceBase(const nlohmann::json &config)
   {
-    _inputParser = std::make_unique<jaffar::InputParser>(config);
+    _inputParser = std::make_shared<jaffar::InputParser>(config);
   }
 
   virtual ~EmuInstanceBase() = default;
 
+  // Creates a new live instance in the same emulation state, sharing whatever does not change once the ROM is loaded.
+  // The source must not be advanced by another thread while it is being cloned
+  virtual std::unique_ptr<EmuInstanceBase> clone() const = 0;
+
   virtual void advanceState(const jaffar::input_t &input)
   {
     // Parsing power
     if (input.power == true) JAFFAR_THROW_RUNTIME("Power button pressed, but not supported");
 
+    // If enabled, try replaying a previously emulated transition instead
+    if (_transitionCache != nullptr) { advanceStateCached(input); return; }
+
     // Parsing reset
     if (input.reset == true) doSoftReset();
 
     advanceStateImpl(input);
   }
 
+  // Advances one frame per input. If hashes is given, it receives the state hash after each frame
+  virtual void advanceStates(const jaffar::input_t *inputs, const size_t count, jaffarCommon::hash::hash_t *hashes = nullptr)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      advanceState(inputs[i]);
+      if (hashes != nullptr) hashes[i] = getStateHash();
+    }
+  }
+
+  // Enables memoization of frame advances, keyed on the serialized state and the input, within the given memory budget.
+  // Rendering is not updated on cache hits, and keys only cover the enabled state blocks
+  void enableTransitionCache(const size_t maxBytes)
+  {
+    // Entries are sized after the state, which is only known once the ROM is loaded
+    if (_stateSize == 0) JAFFAR_THROW_LOGIC("The transition cache can only be enabled after loading the ROM\n");
+
+    _transitionCacheMaxBytes = maxBytes;
+    _transitionCache = std::make_unique<TransitionCache>(maxBytes, _stateSize);
+    _transitionStateBuffer.resize(_stateSize);
+  }
+
+  void disableTransitionCache()
+  {
+    _transitionCache.reset();
+    _transitionStateBuffer.clear();
+  }
+
+  inline TransitionCache *getTransitionCache() const { return _transitionCache.get(); }
+
+  // Hashes of different modes are not comparable with each other
+  void setStateHashMode(const stateHashMode_t mode)
+  {
+    _stateHashMode = mode;
+    _zobristHashValid = false;
+  }
+
+  inline stateHashMode_t getStateHashMode() const { return _stateHashMode; }
+
   inline jaffarCommon::hash::hash_t getStateHash() const
   {
+    // Copying the whole work RAM with a single virtual call (the core is still read one byte per call)
+    uint8_t workRam[_WORK_RAM_SIZE];
+    getWorkRam(workRam);
+
+    if (_stateHashMode != metroHash) return updateZobristHash(workRam);
+
     MetroHash128 hash;
-    
-    //  Getting RAM pointer and size
-    for (size_t i = 0; i < 128; i++) hash.Update(getWorkRamByte(i));
+    hash.Update(workRam, _WORK_RAM_SIZE);
 
     jaffarCommon::hash::hash_t result;
     hash.Finalize(reinterpret_cast<uint8_t *>(&result));
@@ -59,22 +121,21 @@ class EmuInstanceBase
     auto status = loadROMImpl(romFilePath);
     if (status == false) JAFFAR_THROW_RUNTIME("Could not process ROM file");
 
-    _stateSize = getStateSizeImpl();
-    _differentialStateSize = getDifferentialStateSizeImpl();
+    updateStateSizes();
   }
 
   void enableStateBlock(const std::string& block) 
   {
     enableStateBlockImpl(block);
-    _stateSize = getStateSizeImpl();
-    _differentialStateSize = getDifferentialStateSizeImpl();
+    updateStateSizes();
+    if (_transitionCache != nullptr) enableTransitionCache(_transitionCacheMaxBytes);
   }
 
   void disableStateBlock(const std::string& block)
   {
      disableStateBlockImpl(block);
-    _stateSize = getStateSizeImpl();
-    _differentialStateSize = getDifferentialStateSizeImpl();
+    updateStateSizes();
+    if (_transitionCache != nullptr) enableTransitionCache(_transitionCacheMaxBytes);
   }
 
   inline size_t getStateSize() const 
@@ -92,6 +153,7 @@ class EmuInstanceBase
   // Virtual functions
 
   virtual void updateRenderer() = 0;
+  virtual void getWorkRam(uint8_t *buffer) const = 0;
   virtual void serializeState(jaffarCommon::serializer::Base& s) const = 0;
   virtual void deserializeState(jaffarCommon::deserializer::Base& d) = 0;
 
@@ -101,6 +163,16 @@ class EmuInstanceBase
 
   protected:
 
+  // Used by clones: shares the input parser, and keeps the state hash mode and the transition cache budget (not its contents)
+  EmuInstanceBase(const EmuInstanceBase &source)
+    : _stateSize(source._stateSize)
+    , _inputParser(source._inputParser)
+    , _differentialStateSize(source._differentialStateSize)
+    , _stateHashMode(source._stateHashMode)
+  {
+    if (source._transitionCache != nullptr) enableTransitionCache(source._transitionCacheMaxBytes);
+  }
+
   virtual uint8_t getWorkRamByte(size_t pos) const = 0;
   virtual bool loadROMImpl(const std::string &romData) = 0;
   virtual void advanceStateImpl(const jaffar::input_t &input) = 0;
@@ -110,17 +182,123 @@ class EmuInstanceBase
 
   virtual size_t getStateSizeImpl() const = 0;
   virtual size_t getDifferentialStateSizeImpl() const = 0;
+
+  // Caches the state sizes, after anything that changes the serialized layout
+  void updateStateSizes()
+  {
+    _stateSize = getStateSizeImpl();
+    _differentialStateSize = getDifferentialStateSizeImpl();
+  }
   
-  // State size
-  size_t _stateSize;
+  // State size (0 until the ROM is loaded)
+  size_t _stateSize = 0;
 
   private:
 
-  // Input parser instance
-  std::unique_ptr<jaffar::InputParser> _inputParser;
+  // Key for a work RAM byte holding a given value (splitmix64 of its position and value, so no key table is needed)
+  static inline jaffarCommon::hash::hash_t getZobristKey(const size_t address, const uint8_t value)
+  {
+    const auto mix = [](uint64_t x) {
+      x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+      x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+      return x ^ (x >> 31);
+    };
+    const uint64_t seed = ((uint64_t)address << 8 | value) * 0x9E3779B97F4A7C15ull;
+    return jaffarCommon::hash::hash_t(mix(seed), mix(seed + 0x9E3779B97F4A7C15ull));
+  }
+
+  static inline jaffarCommon::hash::hash_t calculateZobristHash(const uint8_t *workRam)
+  {
+    jaffarCommon::hash::hash_t hash(0, 0);
+    for (size_t i = 0; i < _WORK_RAM_SIZE; i++)
+    {
+      const auto key = getZobristKey(i, workRam[i]);
+      hash.first ^= key.first;
+      hash.second ^= key.second;
+    }
+    return hash;
+  }
+
+  // Updates the Zobrist hash with the bytes that changed since it was last computed, comparing eight bytes at a time
+  jaffarCommon::hash::hash_t updateZobristHash(const uint8_t *workRam) const
+  {
+    if (_zobristHashValid == false)
+    {
+      _zobristHash = calculateZobristHash(workRam);
+      memcpy(_zobristWorkRam, workRam, _WORK_RAM_SIZE);
+      _zobristHashValid = true;
+      return _zobristHash;
+    }
+
+    for (size_t word = 0; word < _WORK_RAM_SIZE; word += sizeof(uint64_t))
+    {
+      uint64_t previous;
+      uint64_t current;
+      memcpy(&previous, &_zobristWorkRam[word], sizeof(uint64_t));
+      memcpy(&current, &workRam[word], sizeof(uint64_t));
+      if (previous == current) continue;
+
+      for (size_t i = word; i < word + sizeof(uint64_t); i++)
+        if (_zobristWorkRam[i] != workRam[i])
+        {
+          const auto previousKey = getZobristKey(i, _zobristWorkRam[i]);
+          const auto currentKey = getZobristKey(i, workRam[i]);
+          _zobristHash.first ^= previousKey.first ^ currentKey.first;
+          _zobristHash.second ^= previousKey.second ^ currentKey.second;
+          _zobristWorkRam[i] = workRam[i];
+        }
+    }
+
+    if (_stateHashMode == zobristHashChecked && calculateZobristHash(workRam) != _zobristHash) JAFFAR_THROW_RUNTIME("Incremental Zobrist state hash differs from the full one\n");
+
+    return _zobristHash;
+  }
+
+  void advanceStateCached(const jaffar::input_t &input)
+  {
+    // Getting the transition key from the current state and the input
+    {
+      jaffarCommon::serializer::Contiguous s(_transitionStateBuffer.data(), _stateSize);
+      serializeState(s);
+    }
+    const auto key = TransitionCache::getKey(_transitionStateBuffer.data(), _stateSize, input);
+
+    // If already emulated, restore its resulting state
+    const auto cachedState = _transitionCache->lookup(key);
+    if (cachedState != nullptr)
+    {
+      jaffarCommon::deserializer::Contiguous d(cachedState, _stateSize);
+      deserializeState(d);
+      return;
+    }
+
+    // Otherwise, emulate and store the result
+    if (input.reset == true) doSoftReset();
+    advanceStateImpl(input);
+
+    {
+      jaffarCommon::serializer::Contiguous s(_transitionStateBuffer.data(), _stateSize);
+      serializeState(s);
+    }
+    _transitionCache->insert(key, _transitionStateBuffer.data());
+  }
+
+  // Transition cache, if enabled
+  std::unique_ptr<TransitionCache> _transitionCache;
+  std::vector<uint8_t> _transitionStateBuffer;
+  size_t _transitionCacheMaxBytes = 0;
+
+  // Input parser instance, shared with clones
+  std::shared_ptr<jaffar::InputParser> _inputParser;
 
   // Differential state size
-  size_t _differentialStateSize;
+  size_t _differentialStateSize = 0;
+
+  // State hash mode and, for the Zobrist modes, the hash and the work RAM it was last computed from
+  stateHashMode_t _stateHashMode = metroHash;
+  mutable bool _zobristHashValid = false;
+  mutable jaffarCommon::hash::hash_t _zobristHash;
+  mutable uint8_t _zobristWorkRam[_WORK_RAM_SIZE];
 };
 
 } // namespace libA2600Hawk
\ No newline at end of file
@@ -2,12 +2,19 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <map>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <tuple>
 #include <SDL.h>
 #include <jaffarCommon/exceptions.hpp>
 #include <jaffarCommon/file.hpp>
 #include <jaffarCommon/serializers/contiguous.hpp>
 #include <jaffarCommon/deserializers/contiguous.hpp>
 #include "../a2600HawkInstanceBase.hpp"
+#include "../romRegistry.hpp"
 #include "Atari2600Hawk.h"
 #include "Atari2600Controller.h"
 #include "Atari2600MemoryDomain.h"
@@ -15,18 +22,55 @@
 namespace libA2600Hawk
 {
 
+// Number of frames to emulate while probing the layout of the core's state
+#define _STATE_BLOCK_PROBE_FRAMES 60
+
+// Number of probe frames in which rendering must change the state before the video buffer span is trusted
+#define _VIDEO_BUFFER_MIN_PROBE_FRAMES 4
+
+// Static runs shorter than this are not worth a separate diff, and are stored along with the mutable bytes around them
+#define _DIFFERENTIAL_MIN_STATIC_RUN 32
+
+// Room reserved for the length prefix and encoder framing that each diffed segment adds, on top of the differences themselves
+#define _DIFFERENTIAL_SEGMENT_OVERHEAD 64
+
 class EmuInstance : public EmuInstanceBase
 {
  public:
 
+  // How the state is written into a differential serializer:
+  // - rawState: the whole state, stored as-is (the default)
+  // - genericDiff: the whole state, diffed byte by byte against the reference
+  // - mutableRegions: the bytes that change from frame to frame stored as-is, and the rest diffed against the reference
+  enum differentialMode_t { rawState, genericDiff, mutableRegions };
+
+  // How much output the core produces when advancing a frame:
+  // - fast: no output is produced
+  // - video: renders the frame into the video buffer (or window)
+  // - videoAndAudio: also generates the audio samples
+  enum advanceMode_t { fast, video, videoAndAudio };
+
   EmuInstance(const nlohmann::json &config) : EmuInstanceBase(config)
  {
  }
  
  ~EmuInstance()
  {
+   // The core exports no way of destroying an instance, so its core is kept for the next clone instead
+   if (_sharedCoreData != nullptr) releaseCore();
  }
 
+  // Clones get a core of their own (a recycled one if an instance sharing this ROM was destroyed) and load the source's
+  // state into it. The core state is an opaque blob that cannot be shared copy-on-write, but the ROM image, the probed state
+  // layout and the input parser are shared, and the state layout is not probed again. Video output is not cloned
+  std::unique_ptr<EmuInstanceBase> clone() const override
+  {
+    return std::unique_ptr<EmuInstanceBase>(new EmuInstance(*this));
+  }
+
+  // Number of cores created so far for the instances of this ROM
+  size_t getSharedCoreCount() const { return _sharedCoreData->coreCount; }
+
   virtual void initialize() override
   {
 	_settings.ShowBG = true;
@@ -49,16 +93,37 @@ class EmuInstance : public EmuInstanceBase
 	_syncSettings.LeftDifficulty = true;
 	_syncSettings.RightDifficulty = true;
 	_syncSettings.FastScBios = false;
-
-  _hawkController = Atari2600Controller_Create();
   }
 
   virtual bool loadROMImpl(const std::string &romFilePath) override
   {
-    std::string romData;
-    jaffarCommon::file::loadStringFromFile(romData, romFilePath);
-   _a2600 = Atari2600Hawk_Create((uint8_t*)romData.data(), romData.size(), &_settings, &_syncSettings);
-   _ramDomain = Atari2600Hawk_GetMemoryDomain(_a2600, MainRAM);
+    // Every instance of the same ROM in this process shares its image, state layout and idle cores
+    _sharedCoreData = getSharedCoreData(jaffar::RomRegistry::get().load(romFilePath));
+    acquireCore();
+
+    // The first instance probes the state layout, with a core fresh from the ROM. The others wait for it, and start from its power-on state
+    std::lock_guard<std::mutex> lock(_sharedCoreData->layoutMutex);
+    if (_sharedCoreData->powerOnState.empty() == true)
+    {
+      // Getting the size of the full core state. It is constant from here on, so this is the only time the core is asked
+      _fullStateSize = probeStateSize();
+      _liteStateSaveBuffer.resize(_fullStateSize);
+      _liteStateLoadBuffer.resize(_fullStateSize);
+
+      // Finding which parts of the core state can be excluded, and which ones change from frame to frame
+      probeStateLayout();
+      _sharedCoreData->stateBlocks = _stateBlocks;
+      _sharedCoreData->powerOnState = _liteStateLoadBuffer;
+    }
+    else
+    {
+      _fullStateSize = _sharedCoreData->powerOnState.size();
+      _stateBlocks = _sharedCoreData->stateBlocks;
+      _liteStateSaveBuffer.resize(_fullStateSize);
+      _liteStateLoadBuffer = _sharedCoreData->powerOnState;
+      Atari2600Hawk_LoadStateBinary(_a2600, _liteStateLoadBuffer.data(), _fullStateSize);
+    }
+    updateSerializationSegments();
 
     return true;
   }
@@ -68,10 +133,7 @@ class EmuInstance : public EmuInstanceBase
     // Opening rendering window
     SDL_SetMainReady();
 
-   _videoBufferHeight = Atari2600Hawk_GetBufferHeight(_a2600);
-   _videoBufferWeight = Atari2600Hawk_GetBufferWidth(_a2600);
-   _videoBufferSize = _videoBufferHeight * _videoBufferWeight * sizeof(uint32_t);
-   _videoBuffer = malloc(_videoBufferSize);
+    initializeHeadlessVideoOutput();
 
     // We can only call SDL_InitSubSystem once
     if (!SDL_WasInit(SDL_INIT_VIDEO))
@@ -87,72 +149,226 @@ class EmuInstance : public EmuInstanceBase
     SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 255);
   }
 
+  // Only allocates the video buffer, without initializing SDL, so frames can be captured on machines without a display
+  void initializeHeadlessVideoOutput()
+  {
+   _videoBufferHeight = Atari2600Hawk_GetBufferHeight(_a2600);
+   _videoBufferWeight = Atari2600Hawk_GetBufferWidth(_a2600);
+   _videoBufferSize = _videoBufferHeight * _videoBufferWeight * sizeof(uint32_t);
+   _videoBuffer = malloc(_videoBufferSize);
+  }
+
   void finalizeVideoOutput() override
   {
     if (m_tex) SDL_DestroyTexture(m_tex);
     if (m_renderer) SDL_DestroyRenderer(m_renderer);
     if (m_window) SDL_DestroyWindow(m_window);
     free(_videoBuffer);
+
+    // Any later rendering must not reach the destroyed texture
+    m_tex = nullptr;
+    m_renderer = nullptr;
+    m_window = nullptr;
+    _videoBuffer = nullptr;
   }
 
+  // Goes back to the mode that rendered last (video, unless another one was set)
   void enableRendering() override
   {
-    _doRendering = true;
+    if (_advanceMode == fast) _advanceMode = _renderingAdvanceMode;
   }
 
   void disableRendering() override
   {
-    _doRendering = false;
+    if (_advanceMode != fast) _renderingAdvanceMode = _advanceMode;
+    _advanceMode = fast;
+  }
+
+  // Sets the mode used by all subsequent frame advances
+  void setAdvanceMode(const advanceMode_t mode)
+  {
+    _advanceMode = mode;
+    if (mode != fast) _renderingAdvanceMode = mode;
+  }
+
+  advanceMode_t getAdvanceMode() const { return _advanceMode; }
+
+  using EmuInstanceBase::advanceState;
+
+  // Advances a single frame with the given mode, leaving the configured one unchanged
+  void advanceState(const jaffar::input_t &input, const advanceMode_t mode)
+  {
+    const auto configuredMode = _advanceMode;
+    _advanceMode = mode;
+    advanceState(input);
+    _advanceMode = configuredMode;
   }
 
+  // Diffed segments are pushed with push(), which a contiguous serializer stores as-is, so the serializer type is not needed
   void serializeState(jaffarCommon::serializer::Base& s) const override
   {
-    void* buffer = s.getOutputDataBuffer();
-    Atari2600Hawk_SaveStateBinary(_a2600, (uint8_t*)buffer, _stateSize);
-    s.pushContiguous(nullptr, _stateSize);
+    // Without disabled blocks or diffing, the core writes directly into the output
+    if (_isDirectSerialization == true)
+    {
+      void* buffer = s.getOutputDataBuffer();
+      Atari2600Hawk_SaveStateBinary(_a2600, (uint8_t*)buffer, _stateSize);
+      s.pushContiguous(nullptr, _stateSize);
+      return;
+    }
+
+    // Otherwise, the segments between disabled blocks are pushed one by one. This copy cannot be avoided: the core only writes
+    // its whole state into one contiguous buffer, and cannot skip blocks or write them to separate places
+    Atari2600Hawk_SaveStateBinary(_a2600, _liteStateSaveBuffer.data(), _fullStateSize);
+    for (const auto &segment : _serializationSegments)
+    {
+      if (segment.isDiffed == true) s.push(&_liteStateSaveBuffer[segment.offset], segment.size);
+      else s.pushContiguous(&_liteStateSaveBuffer[segment.offset], segment.size);
+    }
   }
 
   void deserializeState(jaffarCommon::deserializer::Base& d) override
   {
-    Atari2600Hawk_LoadStateBinary(_a2600, (uint8_t*)d.getInputDataBuffer(), _stateSize);
-    d.popContiguous(nullptr, _stateSize);
+    if (_isDirectSerialization == true)
+    {
+      Atari2600Hawk_LoadStateBinary(_a2600, (uint8_t*)d.getInputDataBuffer(), _stateSize);
+      d.popContiguous(nullptr, _stateSize);
+      return;
+    }
+
+    // Disabled blocks keep the contents they had when they were disabled
+    for (const auto &segment : _serializationSegments)
+    {
+      if (segment.isDiffed == true) d.pop(&_liteStateLoadBuffer[segment.offset], segment.size);
+      else d.popContiguous(&_liteStateLoadBuffer[segment.offset], segment.size);
+    }
+    Atari2600Hawk_LoadStateBinary(_a2600, _liteStateLoadBuffer.data(), _fullStateSize);
   }
 
-  size_t getStateSizeImpl() const override
+  // Selects how the state is written into differential serializers. This changes the differential state size. Any mode other
+  // than rawState also stops contiguous serializers from getting the state straight from the core
+  void setDifferentialMode(const differentialMode_t mode)
+  {
+    _differentialMode = mode;
+    updateSerializationSegments();
+    updateStateSizes();
+  }
+
+  differentialMode_t getDifferentialMode() const { return _differentialMode; }
+
+  // Number of state bytes that changed while probing the state layout
+  size_t getMutableStateSize() const
+  {
+    size_t mutableStateSize = 0;
+    for (const auto &segment : _serializationSegments) if (segment.isMutable == true) mutableStateSize += segment.size;
+    return mutableStateSize;
+  }
+
+  // Advances several frames in a single call. The controller inputs are only passed to the core when they change,
+  // and only the last frame is copied out if rendering
+  void advanceStates(const jaffar::input_t *inputs, const size_t count, jaffarCommon::hash::hash_t *hashes = nullptr) override
+  {
+    // Cached transitions are looked up frame by frame
+    if (getTransitionCache() != nullptr) { EmuInstanceBase::advanceStates(inputs, count, hashes); return; }
+
+    const bool doRendering = _advanceMode != fast;
+    const bool doSound = _advanceMode == videoAndAudio;
+    for (size_t i = 0; i < count; i++)
+    {
+      const auto &input = inputs[i];
+      if (input.power == true) JAFFAR_THROW_RUNTIME("Power button pressed, but not supported");
+      if (input.reset == true) doSoftReset();
+
+      if (i == 0 || input != inputs[i - 1]) setControllerInputs(input);
+      Atari2600Hawk_FrameAdvance(_a2600, _hawkController, doRendering, doSound);
+
+      if (hashes != nullptr) hashes[i] = getStateHash();
+    }
+
+    if (count > 0 && doRendering && _videoBuffer != nullptr) copyVideoBuffer();
+  }
+
+  // Asks the core for its state size. This costs a full serialization, so getStateSize() should be used instead
+  size_t probeStateSize() const
   {
     return Atari2600Hawk_SaveStateBinary(_a2600, nullptr, 0);
   }
 
+  // Constant-time state size query, from the size probed at load time and the disabled blocks
+  size_t getStateSizeImpl() const override
+  {
+    size_t stateSize = _fullStateSize;
+    for (const auto &block : _stateBlocks) if (block.enabled == false) stateSize -= block.size;
+    return stateSize;
+  }
+
+  // Names of the state blocks found in this core's state
+  std::vector<std::string> getStateBlockNames() const
+  {
+    std::vector<std::string> names;
+    for (const auto &block : _stateBlocks) names.push_back(block.name);
+    return names;
+  }
+
   uint8_t getWorkRamByte(size_t pos) const override
   {
     return Atari2600MemoryDomain_PeekByte(_ramDomain, pos);
   }
 
-  void updateRenderer() override
+  void getWorkRam(uint8_t *buffer) const override
   {
-    int pitch = 0;
-    void* pixels;
+    readMemoryDomain(_ramDomain, buffer, 0, _WORK_RAM_SIZE);
+  }
 
-    if (SDL_LockTexture(m_tex, nullptr, &pixels, &pitch) < 0) JAFFAR_THROW_RUNTIME("Coult not lock texture");
-    memcpy(pixels, _videoBuffer, _videoBufferSize);
-    SDL_UnlockTexture(m_tex);
+  // Copies a range of the specified memory domain into the caller-supplied buffer
+  void readMemoryDomain(const Atari2600MemoryDomains domain, uint8_t *buffer, const size_t offset, const size_t size) const
+  {
+    readMemoryDomain(Atari2600Hawk_GetMemoryDomain(_a2600, domain), buffer, offset, size);
+  }
 
+  // The frame is already in the texture, copied there when it was rendered
+  void updateRenderer() override
+  {
     const SDL_Rect BLIT_RECT = {0, 0, (int)_videoBufferWeight, (int)_videoBufferHeight};
     SDL_RenderClear(m_renderer);
     SDL_RenderCopy(m_renderer, m_tex, &BLIT_RECT, &BLIT_RECT);
     SDL_RenderPresent(m_renderer);
   }
 
-  inline size_t getDifferentialStateSizeImpl() const override { return getStateSizeImpl(); }
+  // Size of the part of the state that is stored as-is in a differential serializer, plus the framing of every diffed segment.
+  // The differences themselves are bounded by the configured maximum
+  size_t getDifferentialStateSizeImpl() const override
+  {
+    if (_differentialMode == rawState) return getStateSizeImpl();
+
+    size_t differentialStateSize = 0;
+    for (const auto &segment : _serializationSegments) differentialStateSize += segment.isDiffed == true ? _DIFFERENTIAL_SEGMENT_OVERHEAD : segment.size;
+    return differentialStateSize;
+  }
 
   void enableStateBlockImpl(const std::string& block) override
   {
-    JAFFAR_THROW_LOGIC("State block name: '%s' not found.", block.c_str());
+    getStateBlock(block).enabled = true;
+
+    _hasDisabledStateBlocks = false;
+    for (const auto &stateBlock : _stateBlocks) if (stateBlock.enabled == false) _hasDisabledStateBlocks = true;
+    updateSerializationSegments();
   }
 
   void disableStateBlockImpl(const std::string& block) override
   {
-    JAFFAR_THROW_LOGIC("State block name: '%s' not found", block.c_str());
+    auto &stateBlock = getStateBlock(block);
+
+    // Capturing the current contents, which is what this block will hold after loading a state
+    if (stateBlock.enabled == true)
+    {
+      std::vector<uint8_t> currentState(_fullStateSize);
+      Atari2600Hawk_SaveStateBinary(_a2600, currentState.data(), _fullStateSize);
+      memcpy(&_liteStateLoadBuffer[stateBlock.offset], &currentState[stateBlock.offset], stateBlock.size);
+    }
+
+    stateBlock.enabled = false;
+    _hasDisabledStateBlocks = true;
+    updateSerializationSegments();
   }
 
   void doSoftReset() override
@@ -163,13 +379,139 @@ class EmuInstance : public EmuInstanceBase
   {
   }
 
-  void* getVideoBuffer() const { return _videoBuffer; }
+  // With a window open, rendered frames go straight into its texture and the video buffer is not kept up to date
+  void* getVideoBuffer() const
+  {
+    if (m_tex != nullptr) JAFFAR_THROW_LOGIC("The video buffer is not updated while rendering to a window. Use headless video output to read frames\n");
+    return _videoBuffer;
+  }
+
   size_t getVideoBufferSize() const { return _videoBufferSize; }
+  size_t getVideoBufferWidth() const { return _videoBufferWeight; }
+  size_t getVideoBufferHeight() const { return _videoBufferHeight; }
 
   std::string getCoreName() const override { return "libA2600Hawk"; }
 
 
   void advanceStateImpl(const jaffar::input_t &input) override
+  {
+    setControllerInputs(input);
+
+    const bool doRendering = _advanceMode != fast;
+    Atari2600Hawk_FrameAdvance(_a2600, _hawkController, doRendering, _advanceMode == videoAndAudio);
+    if (doRendering && _videoBuffer != nullptr) copyVideoBuffer();
+  }
+
+  private:
+
+  // A byte range of the core state that can be excluded from serialization
+  struct stateBlock_t
+  {
+    std::string name;
+    size_t offset;
+    size_t size;
+    bool enabled;
+  };
+
+  // A contiguous range of the serialized state, either mutable or static
+  struct serializationSegment_t
+  {
+    size_t offset;
+    size_t size;
+    bool isMutable;
+    bool isDiffed;
+  };
+
+  // Data shared by all instances of a ROM, clones included. Once the first instance has probed the state layout, only the idle cores change
+  struct sharedCoreData_t
+  {
+    std::shared_ptr<const jaffar::romImage_t> romImage;
+    std::atomic<size_t> coreCount{0};
+
+    // State layout, and the state the core starts from after loading the ROM
+    std::mutex layoutMutex;
+    std::vector<stateBlock_t> stateBlocks;
+    std::vector<uint8_t> mutableStateBytes;
+    std::vector<uint8_t> powerOnState;
+
+    // Cores (with their controllers) of destroyed instances, ready to be reused
+    std::mutex idleCoresMutex;
+    std::vector<std::pair<Atari2600Hawk *, Atari2600Controller *>> idleCores;
+  };
+
+  // Shared data for each ROM loaded in this process, by SHA1. It is kept until the process ends, so idle cores are never lost
+  static std::shared_ptr<sharedCoreData_t> getSharedCoreData(const std::shared_ptr<const jaffar::romImage_t> &romImage)
+  {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<sharedCoreData_t>> sharedCoreData;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &entry = sharedCoreData[romImage->sha1];
+    if (entry == nullptr)
+    {
+      entry = std::make_shared<sharedCoreData_t>();
+      entry->romImage = romImage;
+    }
+    return entry;
+  }
+
+  // Used by clone()
+  EmuInstance(const EmuInstance &source)
+    : EmuInstanceBase(source)
+    , _settings(source._settings)
+    , _syncSettings(source._syncSettings)
+    , _advanceMode(source._advanceMode)
+    , _renderingAdvanceMode(source._renderingAdvanceMode)
+    , _fullStateSize(source._fullStateSize)
+    , _stateBlocks(source._stateBlocks)
+    , _hasDisabledStateBlocks(source._hasDisabledStateBlocks)
+    , _serializationSegments(source._serializationSegments)
+    , _differentialMode(source._differentialMode)
+    , _isDirectSerialization(source._isDirectSerialization)
+    , _liteStateSaveBuffer(source._fullStateSize)
+    , _liteStateLoadBuffer(source._liteStateLoadBuffer)
+    , _sharedCoreData(source._sharedCoreData)
+  {
+    acquireCore();
+
+    // Copying the whole core state, including the disabled blocks. What they hold after loading a state comes with the load buffer
+    Atari2600Hawk_SaveStateBinary(source._a2600, _liteStateSaveBuffer.data(), _fullStateSize);
+    Atari2600Hawk_LoadStateBinary(_a2600, _liteStateSaveBuffer.data(), _fullStateSize);
+  }
+
+  EmuInstance &operator=(const EmuInstance &) = delete;
+
+  // Takes an idle core, or creates a new one (and its controller) from the ROM image
+  void acquireCore()
+  {
+    _a2600 = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(_sharedCoreData->idleCoresMutex);
+      if (_sharedCoreData->idleCores.empty() == false)
+      {
+        std::tie(_a2600, _hawkController) = _sharedCoreData->idleCores.back();
+        _sharedCoreData->idleCores.pop_back();
+      }
+    }
+
+    if (_a2600 == nullptr)
+    {
+      const auto &romData = _sharedCoreData->romImage->data;
+      _a2600 = Atari2600Hawk_Create((uint8_t*)romData.data(), romData.size(), &_settings, &_syncSettings);
+      _hawkController = Atari2600Controller_Create();
+      _sharedCoreData->coreCount++;
+    }
+
+    _ramDomain = Atari2600Hawk_GetMemoryDomain(_a2600, MainRAM);
+  }
+
+  void releaseCore()
+  {
+    std::lock_guard<std::mutex> lock(_sharedCoreData->idleCoresMutex);
+    _sharedCoreData->idleCores.push_back({_a2600, _hawkController});
+  }
+
+  inline void setControllerInputs(const jaffar::input_t &input)
   {
     Atari2600Inputs hawkInputs;
     hawkInputs.P1Buttons = (Atari2600PortButtons)input.port1;
@@ -182,20 +524,164 @@ class EmuInstance : public EmuInstanceBase
     hawkInputs.ConsoleButtons = (Atari2600ConsoleButtons)consoleButtons;
 
     Atari2600Controller_SetInputs(_hawkController, &hawkInputs);
-    Atari2600Hawk_FrameAdvance(_a2600, _hawkController, _doRendering, false);
-    if (_doRendering)  Atari2600Hawk_GetVideoBuffer(_a2600, (uint32_t*)_videoBuffer);
   }
 
-  private:
+  stateBlock_t &getStateBlock(const std::string &name)
+  {
+    auto block = std::find_if(_stateBlocks.begin(), _stateBlocks.end(), [&](const stateBlock_t &b) { return b.name == name; });
+    if (block == _stateBlocks.end())
+    {
+      std::string foundBlocks;
+      for (const auto &stateBlock : _stateBlocks) foundBlocks += " '" + stateBlock.name + "'";
+      JAFFAR_THROW_LOGIC("State block '%s' was not found while probing the state layout. Found blocks:%s\n", name.c_str(), foundBlocks == "" ? " none" : foundBlocks.c_str());
+    }
+    return *block;
+  }
+
+  // Adds a state block, keeping them sorted by offset. Blocks that overlap an existing one are ignored
+  void addStateBlock(const std::string &name, const size_t offset, const size_t size)
+  {
+    for (const auto &block : _stateBlocks) if (offset < block.offset + block.size && block.offset < offset + size) return;
+    _stateBlocks.push_back(stateBlock_t{name, offset, size, true});
+    std::sort(_stateBlocks.begin(), _stateBlocks.end(), [](const stateBlock_t &a, const stateBlock_t &b) { return a.offset < b.offset; });
+  }
+
+  // Rebuilds the list of segments to serialize, covering every enabled part of the state
+  void updateSerializationSegments()
+  {
+    _serializationSegments.clear();
+    size_t pos = 0;
+    for (const auto &block : _stateBlocks) if (block.enabled == false)
+    {
+      addSerializationSegments(pos, block.offset);
+      pos = block.offset + block.size;
+    }
+    addSerializationSegments(pos, _fullStateSize);
+
+    // Resolving the encoding once, rather than on every serialization
+    for (auto &segment : _serializationSegments) segment.isDiffed = _differentialMode == genericDiff || (_differentialMode == mutableRegions && segment.isMutable == false);
+    _isDirectSerialization = _hasDisabledStateBlocks == false && _differentialMode == rawState;
+  }
+
+  // Splits a range of the state into runs of mutable and static bytes, merging short static runs into the mutable ones
+  void addSerializationSegments(const size_t start, const size_t end)
+  {
+    const auto &mutableStateBytes = _sharedCoreData->mutableStateBytes;
+    size_t pos = start;
+    while (pos < end)
+    {
+      const bool isMutableRun = mutableStateBytes[pos] != 0;
+      size_t runEnd = pos;
+      while (runEnd < end && (mutableStateBytes[runEnd] != 0) == isMutableRun) runEnd++;
+
+      const bool isMutable = isMutableRun == true || runEnd - pos < _DIFFERENTIAL_MIN_STATIC_RUN;
+      auto &segments = _serializationSegments;
+      if (segments.empty() == false && segments.back().isMutable == isMutable && segments.back().offset + segments.back().size == pos) segments.back().size += runEnd - pos;
+      else segments.push_back(serializationSegment_t{pos, runEnd - pos, isMutable, false});
+
+      pos = runEnd;
+    }
+  }
+
+  // The core state is an opaque blob with no exported layout, so it is probed by emulating a few frames.
+  // A disabled block gets back the contents it had when it was disabled on every load, so only data that never feeds back
+  // into emulation can be a block. The CPU, TIA, RIOT RAM, cartridge mapper and sound registers are all game state, so
+  // they are not offered (and the core exports nothing to tell them apart in the blob anyway). What is probed:
+  // - 'Video Buffer' block: the bytes that differ between advancing a frame with and without rendering, taken over all
+  //   probe frames. It is only offered if at least _VIDEO_BUFFER_MIN_PROBE_FRAMES frames differed and the span is exactly
+  //   the size of the frame buffer. Otherwise (e.g. if too little is drawn) it is not offered, and naming it fails
+  // - Mutable bytes: the ones that change from one (non-rendered) frame to the next. The rest are
+  //   ROM-derived or otherwise constant in practice. A misclassified byte only makes the diff larger
+  void probeStateLayout()
+  {
+    std::vector<uint8_t> initialState(_fullStateSize);
+    std::vector<uint8_t> previousState(_fullStateSize);
+    std::vector<uint8_t> currentState(_fullStateSize);
+    std::vector<uint8_t> renderedState(_fullStateSize);
+    Atari2600Hawk_SaveStateBinary(_a2600, initialState.data(), _fullStateSize);
+    auto &mutableStateBytes = _sharedCoreData->mutableStateBytes;
+    mutableStateBytes.assign(_fullStateSize, 0);
+
+    // Probing with no input
+    Atari2600Inputs hawkInputs;
+    memset(&hawkInputs, 0, sizeof(hawkInputs));
+    Atari2600Controller_SetInputs(_hawkController, &hawkInputs);
+
+    const size_t videoBufferSize = Atari2600Hawk_GetBufferHeight(_a2600) * Atari2600Hawk_GetBufferWidth(_a2600) * sizeof(uint32_t);
+    size_t videoBufferFirst = _fullStateSize;
+    size_t videoBufferLast = 0;
+    size_t videoBufferProbeFrames = 0;
+
+    for (size_t frame = 0; frame < _STATE_BLOCK_PROBE_FRAMES; frame++)
+    {
+      // Advancing without rendering, and marking the bytes that changed
+      Atari2600Hawk_SaveStateBinary(_a2600, previousState.data(), _fullStateSize);
+      Atari2600Hawk_FrameAdvance(_a2600, _hawkController, false, false);
+      Atari2600Hawk_SaveStateBinary(_a2600, currentState.data(), _fullStateSize);
+      for (size_t i = 0; i < _fullStateSize; i++) if (currentState[i] != previousState[i]) mutableStateBytes[i] = 1;
+
+      // Advancing again from the same state with rendering, and then going back to the non-rendered state
+      Atari2600Hawk_LoadStateBinary(_a2600, previousState.data(), _fullStateSize);
+      Atari2600Hawk_FrameAdvance(_a2600, _hawkController, true, false);
+      Atari2600Hawk_SaveStateBinary(_a2600, renderedState.data(), _fullStateSize);
+      Atari2600Hawk_LoadStateBinary(_a2600, currentState.data(), _fullStateSize);
+
+      // Widening the video buffer span with the bytes that differ in this frame
+      size_t first = 0;
+      size_t last = _fullStateSize;
+      while (first < _fullStateSize && renderedState[first] == currentState[first]) first++;
+      while (last > first && renderedState[last - 1] == currentState[last - 1]) last--;
+      if (first == last) continue;
+      videoBufferFirst = std::min(videoBufferFirst, first);
+      videoBufferLast = std::max(videoBufferLast, last);
+      videoBufferProbeFrames++;
+    }
+
+    if (videoBufferProbeFrames >= _VIDEO_BUFFER_MIN_PROBE_FRAMES && videoBufferLast - videoBufferFirst == videoBufferSize) addStateBlock("Video Buffer", videoBufferFirst, videoBufferSize);
+
+    // Going back to the power-on state
+    Atari2600Hawk_LoadStateBinary(_a2600, initialState.data(), _fullStateSize);
+    memcpy(_liteStateLoadBuffer.data(), initialState.data(), _fullStateSize);
+  }
+
+  // Gets the rendered frame from the core. With a window open, the core writes it straight into the locked texture
+  // and the video buffer is not updated, so getVideoBuffer() refuses to hand it out. Since this locks the texture,
+  // rendering must happen on the window's thread
+  inline void copyVideoBuffer()
+  {
+    if (m_tex == nullptr) { Atari2600Hawk_GetVideoBuffer(_a2600, (uint32_t*)_videoBuffer); return; }
+
+    int pitch = 0;
+    void* pixels = nullptr;
+    if (SDL_LockTexture(m_tex, nullptr, &pixels, &pitch) < 0) JAFFAR_THROW_RUNTIME("Coult not lock texture");
+
+    // If the texture rows are padded, the frame needs to go through the video buffer
+    const size_t rowSize = _videoBufferWeight * sizeof(uint32_t);
+    if ((size_t)pitch == rowSize) Atari2600Hawk_GetVideoBuffer(_a2600, (uint32_t*)pixels);
+    else
+    {
+      Atari2600Hawk_GetVideoBuffer(_a2600, (uint32_t*)_videoBuffer);
+      for (size_t row = 0; row < _videoBufferHeight; row++) memcpy((uint8_t*)pixels + row * pitch, (uint8_t*)_videoBuffer + row * rowSize, rowSize);
+    }
+
+    SDL_UnlockTexture(m_tex);
+  }
+
+  inline void readMemoryDomain(struct Atari2600MemoryDomain *domain, uint8_t *buffer, const size_t offset, const size_t size) const
+  {
+    // The core exports no bulk peek, so this still makes one core call per byte. Keeping the loop here, out of the virtual
+    // interface, only saves a virtual call per byte
+    for (size_t i = 0; i < size; i++) buffer[i] = Atari2600MemoryDomain_PeekByte(domain, offset + i);
+  }
 
   // Window pointer
-  SDL_Window *m_window;
+  SDL_Window *m_window = nullptr;
 
   // Renderer
-  SDL_Renderer *m_renderer;
+  SDL_Renderer *m_renderer = nullptr;
 
   // SDL Textures
-  SDL_Texture *m_tex;
+  SDL_Texture *m_tex = nullptr;
   
   struct Atari2600Settings _settings;
   struct Atari2600SyncSettings _syncSettings;
@@ -206,10 +692,32 @@ class EmuInstance : public EmuInstanceBase
 
   uint32_t _videoBufferHeight;
   uint32_t _videoBufferWeight;
-  void* _videoBuffer;
+  void* _videoBuffer = nullptr;
   size_t _videoBufferSize;
 
-  bool _doRendering = false;
+  advanceMode_t _advanceMode = fast;
+
+  // Mode restored when rendering is enabled again
+  advanceMode_t _renderingAdvanceMode = video;
+
+  // Size of the core state with all blocks enabled
+  size_t _fullStateSize;
+
+  // State blocks found in the core state, sorted by offset
+  std::vector<stateBlock_t> _stateBlocks;
+  bool _hasDisabledStateBlocks = false;
+
+  // Segments to serialize, from the bytes of the full state that changed while probing (kept in the shared data)
+  std::vector<serializationSegment_t> _serializationSegments;
+  differentialMode_t _differentialMode = rawState;
+  bool _isDirectSerialization = true;
+
+  // Full state buffers used when some blocks are disabled or the state is diffed
+  mutable std::vector<uint8_t> _liteStateSaveBuffer;
+  std::vector<uint8_t> _liteStateLoadBuffer;
+
+  // ROM image, state layout and idle cores, shared with the other instances of this ROM
+  std::shared_ptr<sharedCoreData_t> _sharedCoreData;
 };
 
 } // namespace libA2600Hawk
\ No newline at end of file
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <jaffarCommon/exceptions.hpp>
+#include <jaffarCommon/hash.hpp>
+#include <jaffarCommon/serializers/contiguous.hpp>
+#include <jaffarCommon/deserializers/contiguous.hpp>
+#include "a2600HawkInstance.hpp"
+
+// Number of consecutive lanes a thread takes at a time
+#define _BATCH_ENGINE_BLOCK_SIZE 32
+
+namespace jaffar
+{
+
+// Advances batches of independent states by one frame each, each lane with its own input. States are passed as one contiguous
+// array of serialized states, with the inputs, successors and hashes in arrays of their own. Every thread keeps a clone of the
+// source instance warm between batches, and takes blocks of consecutive lanes from a shared counter, so it reads and writes the
+// state array sequentially. The calling thread works on the batch too. Not thread-safe: one batch runs at a time
+class BatchEngine
+{
+  public:
+
+  BatchEngine(const libA2600Hawk::EmuInstance &source, const size_t threadCount, const size_t blockSize = _BATCH_ENGINE_BLOCK_SIZE)
+    : _stateSize(source.getStateSize())
+    , _blockSize(blockSize)
+  {
+    if (threadCount == 0) JAFFAR_THROW_LOGIC("The batch engine needs at least one thread\n");
+    if (blockSize == 0) JAFFAR_THROW_LOGIC("The batch engine block size must be at least 1\n");
+
+    for (size_t i = 0; i < threadCount; i++) _instances.push_back(source.clone());
+    for (size_t i = 1; i < threadCount; i++) _threads.emplace_back([this, i]() { workerLoop(*_instances[i]); });
+  }
+
+  ~BatchEngine()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _startCondition.notify_all();
+    for (auto &thread : _threads) thread.join();
+  }
+
+  BatchEngine(const BatchEngine &) = delete;
+  BatchEngine &operator=(const BatchEngine &) = delete;
+
+  // Size of each serialized state in the state arrays
+  inline size_t getStateSize() const { return _stateSize; }
+  inline size_t getThreadCount() const { return _instances.size(); }
+
+  // Advances lane i from the state at states + i * stateSize with inputs[i], writing its successor at successors + i * stateSize
+  // and, if given, the successor's state hash at hashes[i]. The successors may overwrite the states
+  void advance(const uint8_t *states, const jaffar::input_t *inputs, const size_t count, uint8_t *successors, jaffarCommon::hash::hash_t *hashes = nullptr)
+  {
+    if (count == 0) return;
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _batch = batch_t{states, inputs, count, successors, hashes};
+      _nextBlock = 0;
+      _pendingWorkers = _threads.size();
+      _workerException = nullptr;
+      _generation++;
+    }
+    _startCondition.notify_all();
+
+    // Working on the batch as well, and then waiting for the others to finish theirs, even if this one failed
+    std::exception_ptr callerException = nullptr;
+    try { runBlocks(*_instances[0]); }
+    catch (...) { callerException = std::current_exception(); }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _doneCondition.wait(lock, [this]() { return _pendingWorkers == 0; });
+    if (callerException != nullptr) std::rethrow_exception(callerException);
+    if (_workerException != nullptr) std::rethrow_exception(_workerException);
+  }
+
+  private:
+
+  struct batch_t
+  {
+    const uint8_t *states;
+    const jaffar::input_t *inputs;
+    size_t count;
+    uint8_t *successors;
+    jaffarCommon::hash::hash_t *hashes;
+  };
+
+  void workerLoop(libA2600Hawk::EmuInstanceBase &e)
+  {
+    size_t generation = 0;
+    while (true)
+    {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _startCondition.wait(lock, [&]() { return _stop == true || _generation != generation; });
+        if (_stop == true) return;
+        generation = _generation;
+      }
+
+      try { runBlocks(e); }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_workerException == nullptr) _workerException = std::current_exception();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pendingWorkers--;
+      }
+      _doneCondition.notify_one();
+    }
+  }
+
+  void runBlocks(libA2600Hawk::EmuInstanceBase &e)
+  {
+    const auto &batch = _batch;
+    for (size_t block = _nextBlock++; block * _blockSize < batch.count; block = _nextBlock++)
+    {
+      const size_t firstLane = block * _blockSize;
+      const size_t lastLane = std::min(firstLane + _blockSize, batch.count);
+      for (size_t lane = firstLane; lane < lastLane; lane++)
+      {
+        jaffarCommon::deserializer::Contiguous d(batch.states + lane * _stateSize, _stateSize);
+        e.deserializeState(d);
+        e.advanceState(batch.inputs[lane]);
+        jaffarCommon::serializer::Contiguous s(batch.successors + lane * _stateSize, _stateSize);
+        e.serializeState(s);
+        if (batch.hashes != nullptr) batch.hashes[lane] = e.getStateHash();
+      }
+    }
+  }
+
+  const size_t _stateSize;
+  const size_t _blockSize;
+
+  // One warm instance per thread. The first one is used by the calling thread
+  std::vector<std::unique_ptr<libA2600Hawk::EmuInstanceBase>> _instances;
+  std::vector<std::thread> _threads;
+
+  // Current batch and the next block of lanes to take from it
+  batch_t _batch;
+  std::atomic<size_t> _nextBlock{0};
+
+  // Batch start and completion, guarded by the mutex
+  std::mutex _mutex;
+  std::condition_variable _startCondition;
+  std::condition_variable _doneCondition;
+  size_t _generation = 0;
+  size_t _pendingWorkers = 0;
+  bool _stop = false;
+  std::exception_ptr _workerException;
+};
+
+} // namespace jaffar
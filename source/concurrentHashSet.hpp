@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <jaffarCommon/exceptions.hpp>
+#include <jaffarCommon/hash.hpp>
+
+namespace jaffar
+{
+
+// Fixed-capacity set of state hashes that any number of threads can insert into without locking. Each hash is folded into a
+// 64-bit key, stored with open addressing and linear probing, and a free slot is claimed with a single compare-and-swap.
+// Keys are never removed, so a slot holding a key never changes again
+class ConcurrentHashSet
+{
+  public:
+
+  // The capacity is rounded up to a power of two
+  ConcurrentHashSet(const size_t capacity)
+  {
+    size_t slotCount = 1;
+    while (slotCount < capacity) slotCount *= 2;
+    _mask = slotCount - 1;
+
+    _slots = std::unique_ptr<std::atomic<uint64_t>[]>(new std::atomic<uint64_t>[slotCount]);
+    for (size_t i = 0; i < slotCount; i++) _slots[i].store(_EMPTY_KEY, std::memory_order_relaxed);
+  }
+
+  // Returns true if the hash was not in the set yet
+  inline bool insert(const jaffarCommon::hash::hash_t &hash)
+  {
+    const auto key = getKey(hash);
+    size_t slot = key & _mask;
+    for (size_t probe = 0; probe <= _mask; probe++)
+    {
+      auto current = _slots[slot].load(std::memory_order_relaxed);
+      if (current == key) return false;
+
+      // Another thread may claim the slot first, possibly with this same key
+      if (current == _EMPTY_KEY)
+      {
+        if (_slots[slot].compare_exchange_strong(current, key, std::memory_order_relaxed) == true) return true;
+        if (current == key) return false;
+      }
+
+      slot = (slot + 1) & _mask;
+    }
+
+    JAFFAR_THROW_RUNTIME("The concurrent hash set is full (%lu entries)\n", _mask + 1);
+  }
+
+  inline bool contains(const jaffarCommon::hash::hash_t &hash) const
+  {
+    const auto key = getKey(hash);
+    size_t slot = key & _mask;
+    for (size_t probe = 0; probe <= _mask; probe++)
+    {
+      const auto current = _slots[slot].load(std::memory_order_relaxed);
+      if (current == key) return true;
+      if (current == _EMPTY_KEY) return false;
+      slot = (slot + 1) & _mask;
+    }
+    return false;
+  }
+
+  inline size_t getCapacity() const { return _mask + 1; }
+
+  private:
+
+  static constexpr uint64_t _EMPTY_KEY = 0;
+
+  // The state hash is already well mixed, so folding its halves is enough. The empty key is moved out of the way
+  static inline uint64_t getKey(const jaffarCommon::hash::hash_t &hash)
+  {
+    const uint64_t key = hash.first ^ (hash.second * 0x9E3779B97F4A7C15ull);
+    return key == _EMPTY_KEY ? 1 : key;
+  }
+
+  std::unique_ptr<std::atomic<uint64_t>[]> _slots;
+  size_t _mask;
+};
+
+} // namespace jaffar
@@ -0,0 +1,398 @@
+#include "argparse/argparse.hpp"
+#include <jaffarCommon/json.hpp>
+#include <jaffarCommon/hash.hpp>
+#include <jaffarCommon/file.hpp>
+#include <jaffarCommon/exceptions.hpp>
+#include "a2600HawkInstance.hpp"
+#include "movieFile.hpp"
+#include "sequenceRunner.hpp"
+#include "workStealingPool.hpp"
+#include "romRegistry.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+
+// Maximum number of games each worker keeps loaded instances for
+#define _CORPUS_MAX_CACHED_GAMES 8
+
+// A test script and input sequence to verify
+struct corpusJob_t
+{
+  size_t id;
+  std::string scriptFilePath;
+  std::string sequenceFilePath;
+  nlohmann::json configJs;
+  std::string romFilePath;
+  std::string initialStateFilePath;
+  std::vector<std::string> stateDisabledBlocks;
+
+  // Movies with the same key can run on the same emulator instances
+  std::string gameKey;
+};
+
+struct corpusResult_t
+{
+  bool passed;
+  std::string error;
+  size_t sequenceLength;
+  double elapsedTimeSeconds;
+  jaffarCommon::hash::hash_t finalHash;
+  size_t workerId;
+  bool reusedInstances;
+};
+
+// Simple and Rerecord instances for a game, and the state they start every movie from
+struct gameInstances_t
+{
+  std::unique_ptr<libA2600Hawk::EmuInstance> simple;
+  std::unique_ptr<libA2600Hawk::EmuInstance> rerecord;
+  std::vector<uint8_t> initialState;
+};
+
+// Paths in a script are relative to the script's own folder
+std::string resolveScriptPath(const std::string &scriptFilePath, const std::string &path)
+{
+  if (path == "" || std::filesystem::path(path).is_absolute()) return path;
+  return (std::filesystem::path(scriptFilePath).parent_path() / path).string();
+}
+
+// Gets the instances for the job's game from the worker's cache, creating them (and evicting the least recently used game) if needed
+gameInstances_t &getGameInstances(std::list<std::pair<std::string, gameInstances_t>> &cache, const corpusJob_t &job, bool &reused)
+{
+  auto entry = std::find_if(cache.begin(), cache.end(), [&](const std::pair<std::string, gameInstances_t> &e) { return e.first == job.gameKey; });
+  reused = entry != cache.end();
+
+  // Moving the game to the front, as the most recently used
+  if (reused == true)
+  {
+    cache.splice(cache.begin(), cache, entry);
+    return cache.front().second;
+  }
+
+  if (cache.size() == _CORPUS_MAX_CACHED_GAMES) cache.pop_back();
+
+  gameInstances_t game;
+  game.simple = createEmuInstance(job.configJs, job.romFilePath, job.initialStateFilePath, job.stateDisabledBlocks);
+  game.rerecord = createEmuInstance(job.configJs, job.romFilePath, job.initialStateFilePath, job.stateDisabledBlocks);
+  game.initialState.resize(game.simple->getStateSize());
+  jaffarCommon::serializer::Contiguous s(game.initialState.data(), game.initialState.size());
+  game.simple->serializeState(s);
+
+  cache.emplace_front(job.gameKey, std::move(game));
+  return cache.front().second;
+}
+
+// Runs the movie's Simple and Rerecord cycles in lockstep on the game's instances, filling in the result as it goes
+void runJob(std::list<std::pair<std::string, gameInstances_t>> &cache, const corpusJob_t &job, const size_t lockstepInterval, corpusResult_t &result)
+{
+  auto &game = getGameInstances(cache, job, result.reusedInstances);
+
+  // Starting both instances from the game's initial state
+  for (auto instance : {game.simple.get(), game.rerecord.get()})
+  {
+    jaffarCommon::deserializer::Contiguous d(game.initialState.data(), game.initialState.size());
+    instance->deserializeState(d);
+  }
+
+  // Decoding the sequence
+  std::vector<jaffar::input_t> decodedSequence;
+  if (jaffar::MovieFile::isMovieFile(job.sequenceFilePath) == true)
+  {
+    jaffar::MovieFile movieFile(job.sequenceFilePath);
+    movieFile.decode(decodedSequence);
+  }
+  else
+  {
+    std::string sequenceRaw;
+    if (jaffarCommon::file::loadStringFromFile(sequenceRaw, job.sequenceFilePath) == false) JAFFAR_THROW_LOGIC("Could not find or read from input sequence file: %s\n", job.sequenceFilePath.c_str());
+    game.simple->getInputParser()->parseInputSequence(sequenceRaw, decodedSequence);
+  }
+  result.sequenceLength = decodedSequence.size();
+
+  // Configuring the cycles with the script's differential compression settings
+  const auto &differentialCompressionJs = jaffarCommon::json::getObject(job.configJs, "Differential Compression");
+  cycleConfiguration_t simpleConfig;
+  simpleConfig.doPreAdvance = false;
+  simpleConfig.doDeserialize = false;
+  simpleConfig.doSerialize = false;
+  simpleConfig.stateSize = game.simple->getStateSize();
+  simpleConfig.differentialCompressionEnabled = jaffarCommon::json::getBoolean(differentialCompressionJs, "Enabled");
+  simpleConfig.differentialCompressionUseZlib = jaffarCommon::json::getBoolean(differentialCompressionJs, "Use Zlib");
+  simpleConfig.fullDifferentialStateSize = game.simple->getDifferentialStateSize() + jaffarCommon::json::getNumber<size_t>(differentialCompressionJs, "Max Differences");
+  simpleConfig.newStatePerStep = false;
+
+  auto rerecordConfig = simpleConfig;
+  rerecordConfig.doPreAdvance = true;
+  rerecordConfig.doDeserialize = true;
+  rerecordConfig.doSerialize = true;
+
+  const auto runResult = runLockstep(*game.simple, *game.rerecord, decodedSequence, simpleConfig, rerecordConfig, lockstepInterval);
+  result.passed = runResult.divergenceReport == "";
+  result.error = runResult.divergenceReport;
+  result.elapsedTimeSeconds = runResult.elapsedTimeSeconds;
+  result.finalHash = runResult.finalHash;
+}
+
+int main(int argc, char *argv[])
+{
+  // Parsing command line arguments
+  argparse::ArgumentParser program("corpusRunner", "1.0");
+
+  program.add_argument("--threads")
+    .help("Number of worker threads (0: one per hardware thread)")
+    .default_value(0)
+    .scan<'i', int>();
+
+  program.add_argument("--lockstepInterval")
+    .help("Number of steps between Simple and Rerecord state hash comparisons")
+    .default_value(1)
+    .scan<'i', int>();
+
+  program.add_argument("--reportFile")
+    .help("Path to save a JSON report with the result of every movie")
+    .default_value(std::string(""));
+
+  program.add_argument("inputs")
+    .help("Folders (every .test script with a .sol sequence of the same name) and test scripts, each optionally followed by its sequence file. Must come after the options.")
+    .remaining();
+
+  // Try to parse arguments
+  try { program.parse_args(argc, argv); } catch (const std::runtime_error &err) { JAFFAR_THROW_LOGIC("%s\n%s", err.what(), program.help().str().c_str()); }
+
+  auto threadCount = (size_t)program.get<int>("--threads");
+  if (program.get<int>("--threads") < 0) JAFFAR_THROW_LOGIC("Invalid thread count: %d\n", program.get<int>("--threads"));
+  if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+  const auto lockstepInterval = program.get<int>("--lockstepInterval");
+  if (lockstepInterval < 1) JAFFAR_THROW_LOGIC("Invalid lockstep interval: %d\n", lockstepInterval);
+
+  const auto reportFile = program.get<std::string>("--reportFile");
+
+  std::vector<std::string> inputs;
+  try { inputs = program.get<std::vector<std::string>>("inputs"); } catch (const std::logic_error &) { }
+  if (inputs.empty() == true) JAFFAR_THROW_LOGIC("No test scripts or folders given\n%s", program.help().str().c_str());
+
+  // Gathering the script / sequence pairs
+  std::vector<std::pair<std::string, std::string>> pairs;
+  for (size_t i = 0; i < inputs.size(); i++)
+  {
+    const std::filesystem::path inputPath(inputs[i]);
+
+    if (std::filesystem::is_directory(inputPath) == true)
+    {
+      std::vector<std::string> scripts;
+      for (const auto &entry : std::filesystem::directory_iterator(inputPath))
+        if (entry.path().extension() == ".test") scripts.push_back(entry.path().string());
+      std::sort(scripts.begin(), scripts.end());
+
+      for (const auto &script : scripts)
+      {
+        const auto sequence = std::filesystem::path(script).replace_extension(".sol").string();
+        if (std::filesystem::exists(sequence) == true) pairs.push_back({script, sequence});
+      }
+      continue;
+    }
+
+    if (inputPath.extension() != ".test") JAFFAR_THROW_LOGIC("Not a test script or folder: %s\n", inputs[i].c_str());
+
+    // The sequence is the next input if it is not a script or a folder, or otherwise the .sol with the script's name
+    if (i + 1 < inputs.size() && std::filesystem::path(inputs[i + 1]).extension() != ".test" && std::filesystem::is_directory(inputs[i + 1]) == false)
+    {
+      pairs.push_back({inputs[i], inputs[i + 1]});
+      i++;
+    }
+    else pairs.push_back({inputs[i], std::filesystem::path(inputPath).replace_extension(".sol").string()});
+  }
+
+  // Parsing scripts and checking their ROMs. Each ROM is read and hashed only once, and the instances share its image
+  std::vector<corpusJob_t> jobs;
+  std::vector<corpusResult_t> results(pairs.size());
+  auto tl0 = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < pairs.size(); i++)
+  {
+    corpusJob_t job;
+    job.id = i;
+    job.scriptFilePath = pairs[i].first;
+    job.sequenceFilePath = pairs[i].second;
+    results[i].passed = false;
+    results[i].sequenceLength = 0;
+    results[i].elapsedTimeSeconds = 0.0;
+    results[i].workerId = 0;
+    results[i].reusedInstances = false;
+    results[i].finalHash = jaffarCommon::hash::hash_t();
+
+    try
+    {
+      std::string configJsRaw;
+      if (jaffarCommon::file::loadStringFromFile(configJsRaw, job.scriptFilePath) == false) JAFFAR_THROW_LOGIC("Could not find/read script file: %s\n", job.scriptFilePath.c_str());
+      job.configJs = nlohmann::json::parse(configJsRaw);
+      job.romFilePath = resolveScriptPath(job.scriptFilePath, jaffarCommon::json::getString(job.configJs, "Rom File"));
+      job.initialStateFilePath = resolveScriptPath(job.scriptFilePath, jaffarCommon::json::getString(job.configJs, "Initial State File"));
+      job.stateDisabledBlocks = jaffarCommon::json::getArray<std::string>(job.configJs, "Disable State Blocks");
+
+      jaffar::RomRegistry::get().load(job.romFilePath, jaffarCommon::json::getString(job.configJs, "Expected ROM SHA1"));
+
+      // Everything that goes into creating the instances, including the controllers the input parser is set up for
+      job.gameKey = job.romFilePath + "|" + job.initialStateFilePath + "|" + jaffarCommon::json::getString(job.configJs, "Controller 1 Type") + "|" + jaffarCommon::json::getString(job.configJs, "Controller 2 Type");
+      for (const auto &block : job.stateDisabledBlocks) job.gameKey += "|" + block;
+    }
+    catch (const std::exception &e)
+    {
+      results[i].error = e.what();
+      printf("[] Skipping '%s': %s\n", job.scriptFilePath.c_str(), results[i].error.c_str());
+      continue;
+    }
+
+    jobs.push_back(job);
+  }
+  auto tl1 = std::chrono::high_resolution_clock::now();
+
+  // Grouping the movies of each game, and handing out whole games to the least loaded worker (by sequence file size), largest first.
+  // Workers then steal from each other to balance out what the estimate got wrong
+  std::map<std::string, std::vector<size_t>> games;
+  std::map<std::string, size_t> gameWeights;
+  for (size_t i = 0; i < jobs.size(); i++)
+  {
+    games[jobs[i].gameKey].push_back(i);
+    std::error_code error;
+    const auto sequenceFileSize = std::filesystem::file_size(jobs[i].sequenceFilePath, error);
+    gameWeights[jobs[i].gameKey] += error ? 0 : (size_t)sequenceFileSize;
+  }
+
+  std::vector<std::string> gameKeys;
+  for (const auto &game : games) gameKeys.push_back(game.first);
+  std::sort(gameKeys.begin(), gameKeys.end(), [&](const std::string &a, const std::string &b) { return gameWeights[a] > gameWeights[b]; });
+
+  jaffar::WorkStealingPool<size_t> pool(threadCount);
+  std::vector<size_t> workerLoads(threadCount, 0);
+  for (const auto &gameKey : gameKeys)
+  {
+    const auto workerId = (size_t)(std::min_element(workerLoads.begin(), workerLoads.end()) - workerLoads.begin());
+    workerLoads[workerId] += gameWeights[gameKey] + 1;
+
+    // Pushed in reverse, since workers take from the back of their own queue
+    const auto &gameJobs = games[gameKey];
+    for (auto job = gameJobs.rbegin(); job != gameJobs.rend(); job++) pool.push(workerId, *job);
+  }
+
+  printf("[] -----------------------------------------\n");
+  printf("[] Corpus Movies:                          %lu\n", pairs.size());
+  printf("[] Games:                                  %lu\n", games.size());
+  printf("[] Worker Threads:                         %lu\n", threadCount);
+  printf("[] Lockstep Interval:                      %d steps\n", lockstepInterval);
+  printf("[] Script Load Time:                       %3.3fms\n", (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tl1 - tl0).count() * 1.0e-6);
+  printf("[] ********** Running Corpus **********\n");
+  fflush(stdout);
+
+  // Running the workers
+  std::mutex outputMutex;
+  std::atomic<size_t> finishedCount(0);
+  std::atomic<size_t> instanceLoadCount(0);
+  std::vector<double> workerBusySeconds(threadCount, 0.0);
+
+  auto t0 = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t workerId = 0; workerId < threadCount; workerId++)
+    threads.emplace_back([&, workerId]() {
+      std::list<std::pair<std::string, gameInstances_t>> cache;
+      size_t jobIdx;
+      while (pool.pop(workerId, jobIdx) == true)
+      {
+        const auto &job = jobs[jobIdx];
+        auto &result = results[job.id];
+
+        auto tj0 = std::chrono::high_resolution_clock::now();
+        try { runJob(cache, job, lockstepInterval, result); }
+        catch (const std::exception &e) { result.passed = false; result.error = e.what(); }
+        auto tj1 = std::chrono::high_resolution_clock::now();
+
+        result.workerId = workerId;
+        if (result.reusedInstances == false) instanceLoadCount++;
+        workerBusySeconds[workerId] += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tj1 - tj0).count() * 1.0e-9;
+
+        std::lock_guard<std::mutex> lock(outputMutex);
+  printf("[] [%4lu/%4lu] %s   %-48s   %8lu steps   %14.3f inputs / s   (worker %lu%s)\n",
+         ++finishedCount,
+         pairs.size(),
+         result.passed ? "PASS" : "FAIL",
+         job.scriptFilePath.c_str(),
+         result.sequenceLength,
+         result.passed ? (double)result.sequenceLength / result.elapsedTimeSeconds : 0.0,
+         workerId,
+         result.reusedInstances ? ", reused" : "");
+        fflush(stdout);
+      }
+    });
+  for (auto &thread : threads) thread.join();
+  auto tf = std::chrono::high_resolution_clock::now();
+  const double wallTimeSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tf - t0).count() * 1.0e-9;
+
+  // Consolidating results
+  size_t passedCount = 0;
+  size_t totalInputs = 0;
+  double busySeconds = 0.0;
+  for (const auto &result : results) if (result.passed == true) { passedCount++; totalInputs += result.sequenceLength; }
+  for (const auto seconds : workerBusySeconds) busySeconds += seconds;
+
+  printf("[] -----------------------------------------\n");
+  printf("[] Passed / Failed:                        %lu / %lu\n", passedCount, pairs.size() - passedCount);
+  printf("[] Instance Loads:                         %lu (%lu movies reused loaded instances)\n", (size_t)instanceLoadCount, jobs.size() - instanceLoadCount);
+  printf("[] Work Steals:                            %lu\n", pool.getStealCount());
+  printf("[] Total Inputs Verified:                  %lu\n", totalInputs);
+  printf("[] Wall Time:                              %3.3fs\n", wallTimeSeconds);
+  printf("[] Aggregate Performance:                  %.3f inputs / s\n", (double)totalInputs / wallTimeSeconds);
+  printf("[] Worker Utilization:                     %.2f%%\n", 100.0 * busySeconds / (wallTimeSeconds * (double)threadCount));
+
+  if (passedCount < pairs.size())
+  {
+  printf("[] Failed Movies:\n");
+    for (size_t i = 0; i < pairs.size(); i++)
+      if (results[i].passed == false)
+  printf("[]   %s (%s): %s\n", pairs[i].first.c_str(), pairs[i].second.c_str(), results[i].error.c_str());
+  }
+
+  // Saving the machine-readable report
+  if (reportFile != "")
+  {
+    nlohmann::json reportJs;
+    reportJs["Threads"] = threadCount;
+    reportJs["Wall Seconds"] = wallTimeSeconds;
+    reportJs["Inputs Per Second"] = (double)totalInputs / wallTimeSeconds;
+    reportJs["Passed"] = passedCount;
+    reportJs["Failed"] = pairs.size() - passedCount;
+    reportJs["Instance Loads"] = (size_t)instanceLoadCount;
+    reportJs["Work Steals"] = pool.getStealCount();
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+      char hashStringBuffer[256];
+      sprintf(hashStringBuffer, "0x%lX%lX", results[i].finalHash.first, results[i].finalHash.second);
+
+      nlohmann::json movieJs;
+      movieJs["Script"] = pairs[i].first;
+      movieJs["Sequence"] = pairs[i].second;
+      movieJs["Passed"] = results[i].passed;
+      movieJs["Error"] = results[i].error;
+      movieJs["Sequence Length"] = results[i].sequenceLength;
+      movieJs["Elapsed Seconds"] = results[i].elapsedTimeSeconds;
+      movieJs["Final State Hash"] = results[i].passed ? std::string(hashStringBuffer) : std::string("");
+      reportJs["Movies"].push_back(movieJs);
+    }
+    if (jaffarCommon::file::saveStringToFile(reportJs.dump(2), reportFile.c_str()) == false) JAFFAR_THROW_LOGIC("Could not write report file: %s\n", reportFile.c_str());
+  }
+
+  if (passedCount < pairs.size())
+  {
+    printf("[] Corpus Failed\n");
+    return -1;
+  }
+
+  printf("[] Corpus Passed\n");
+  return 0;
+}
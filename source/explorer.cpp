@@ -0,0 +1,348 @@
+#include "argparse/argparse.hpp"
+#include <jaffarCommon/json.hpp>
+#include <jaffarCommon/hash.hpp>
+#include <jaffarCommon/file.hpp>
+#include <jaffarCommon/exceptions.hpp>
+#include <jaffarCommon/serializers/contiguous.hpp>
+#include <jaffarCommon/deserializers/contiguous.hpp>
+#include "a2600HawkInstance.hpp"
+#include "sequenceRunner.hpp"
+#include "workStealingPool.hpp"
+#include "concurrentHashSet.hpp"
+#include "romRegistry.hpp"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <string>
+
+// Number of frontier states in each work item
+#define _EXPLORER_CHUNK_SIZE 64
+
+// A range of frontier states
+struct explorationChunk_t
+{
+  size_t first;
+  size_t last;
+};
+
+// A successor not seen in earlier levels. Its index (frontier index * input count + input index) decides which of the
+// successors with the same state hash is kept, so the result does not depend on which worker got there first
+struct explorationCandidate_t
+{
+  size_t index;
+  jaffarCommon::hash::hash_t hash;
+  size_t offset;
+  size_t workerId;
+};
+
+struct levelResult_t
+{
+  size_t frontierSize;
+  size_t generatedStates;
+  size_t newStates;
+  uint64_t newStatesDigest;
+  double elapsedTimeSeconds;
+};
+
+struct explorationResult_t
+{
+  std::vector<levelResult_t> levels;
+  size_t uniqueStates;
+  size_t generatedStates;
+  size_t stealCount;
+  bool stateLimitReached;
+  double elapsedTimeSeconds;
+};
+
+// Explores breadth-first from the root state, advancing every frontier state with every input and keeping the successors whose
+// state hash was not seen before. Each level is split into chunks, spread over the workers' queues, and idle workers steal from
+// the others. Workers keep the successors not seen in earlier levels in buffers of their own. Once the level is done, these are
+// taken in (frontier index, input index) order, so the first successor with each hash is the one kept, and the next frontier is
+// the same for any number of threads
+explorationResult_t explore(std::vector<std::unique_ptr<libA2600Hawk::EmuInstanceBase>> &instances,
+                            const size_t threadCount,
+                            const std::vector<uint8_t> &rootState,
+                            const std::vector<jaffar::input_t> &inputs,
+                            const size_t maxDepth,
+                            const size_t maxStates)
+{
+  const size_t stateSize = rootState.size();
+  explorationResult_t result;
+  result.uniqueStates = 1;
+  result.generatedStates = 0;
+  result.stealCount = 0;
+  result.stateLimitReached = false;
+
+  // Keeping the hash set at most half full
+  jaffar::ConcurrentHashSet visitedStates(maxStates * 2);
+  {
+    jaffarCommon::deserializer::Contiguous d(rootState.data(), stateSize);
+    instances[0]->deserializeState(d);
+    visitedStates.insert(instances[0]->getStateHash());
+  }
+
+  std::vector<uint8_t> frontier = rootState;
+  size_t frontierSize = 1;
+
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (size_t depth = 1; depth <= maxDepth && frontierSize > 0; depth++)
+  {
+    // Stopping before a level that could take more states than allowed
+    if (result.uniqueStates + frontierSize * inputs.size() > maxStates)
+    {
+      result.stateLimitReached = true;
+      break;
+    }
+
+    jaffar::WorkStealingPool<explorationChunk_t> pool(threadCount);
+    size_t chunkCount = 0;
+    for (size_t first = 0; first < frontierSize; first += _EXPLORER_CHUNK_SIZE)
+      pool.push(chunkCount++ % threadCount, explorationChunk_t{first, std::min(first + _EXPLORER_CHUNK_SIZE, frontierSize)});
+
+    std::vector<std::vector<uint8_t>> candidateStates(threadCount);
+    std::vector<std::vector<explorationCandidate_t>> candidates(threadCount);
+    std::mutex errorMutex;
+    std::exception_ptr error = nullptr;
+
+    auto tl0 = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t workerId = 0; workerId < threadCount; workerId++)
+      threads.emplace_back([&, workerId]() {
+        try
+        {
+          auto &e = *instances[workerId];
+          auto &states = candidateStates[workerId];
+          auto &workerCandidates = candidates[workerId];
+
+          explorationChunk_t chunk;
+          while (pool.pop(workerId, chunk) == true)
+            for (size_t i = chunk.first; i < chunk.last; i++)
+              for (size_t inputIdx = 0; inputIdx < inputs.size(); inputIdx++)
+              {
+                jaffarCommon::deserializer::Contiguous d(&frontier[i * stateSize], stateSize);
+                e.deserializeState(d);
+                e.advanceState(inputs[inputIdx]);
+                const auto hash = e.getStateHash();
+                if (visitedStates.contains(hash) == true) continue;
+
+                const size_t offset = states.size();
+                states.resize(offset + stateSize);
+                jaffarCommon::serializer::Contiguous s(&states[offset], stateSize);
+                e.serializeState(s);
+                workerCandidates.push_back(explorationCandidate_t{i * inputs.size() + inputIdx, hash, offset, workerId});
+              }
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock(errorMutex);
+          if (error == nullptr) error = std::current_exception();
+        }
+      });
+    for (auto &thread : threads) thread.join();
+    if (error != nullptr) std::rethrow_exception(error);
+
+    // Keeping the first successor with each hash, in (frontier index, input index) order
+    std::vector<explorationCandidate_t> orderedCandidates;
+    for (const auto &workerCandidates : candidates) orderedCandidates.insert(orderedCandidates.end(), workerCandidates.begin(), workerCandidates.end());
+    std::sort(orderedCandidates.begin(), orderedCandidates.end(), [](const explorationCandidate_t &a, const explorationCandidate_t &b) { return a.index < b.index; });
+
+    levelResult_t level;
+    level.frontierSize = frontierSize;
+    level.generatedStates = frontierSize * inputs.size();
+    level.newStates = 0;
+    level.newStatesDigest = 0;
+    std::vector<uint8_t> nextFrontier;
+    nextFrontier.reserve(orderedCandidates.size() * stateSize);
+    for (const auto &candidate : orderedCandidates)
+    {
+      if (visitedStates.insert(candidate.hash) == false) continue;
+      const auto state = &candidateStates[candidate.workerId][candidate.offset];
+      nextFrontier.insert(nextFrontier.end(), state, state + stateSize);
+      level.newStates++;
+      level.newStatesDigest = level.newStatesDigest * 0x100000001B3ull ^ candidate.index;
+    }
+    auto tl1 = std::chrono::high_resolution_clock::now();
+
+    level.elapsedTimeSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tl1 - tl0).count() * 1.0e-9;
+    result.levels.push_back(level);
+
+    result.uniqueStates += level.newStates;
+    result.generatedStates += level.generatedStates;
+    result.stealCount += pool.getStealCount();
+
+    frontier = std::move(nextFrontier);
+    frontierSize = level.newStates;
+  }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  result.elapsedTimeSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() * 1.0e-9;
+
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  // Parsing command line arguments
+  argparse::ArgumentParser program("explorer", "1.0");
+
+  program.add_argument("scriptFile")
+    .help("Path to the test script file to run.")
+    .required();
+
+  program.add_argument("inputSetFile")
+    .help("Path to a file with the inputs to try from every state, one input string per line (e.g. a .sol sequence). Repeated inputs are tried once.")
+    .required();
+
+  program.add_argument("--depth")
+    .help("Number of frames to explore")
+    .default_value(8)
+    .scan<'i', int>();
+
+  program.add_argument("--maxStates")
+    .help("Maximum number of unique states. Exploration stops before a level that could exceed it")
+    .default_value(262144)
+    .scan<'i', int>();
+
+  program.add_argument("--threads")
+    .help("Explores with 1 up to the given number of threads (doubling each time), and reports the scaling efficiency")
+    .default_value(1)
+    .scan<'i', int>();
+
+  // Try to parse arguments
+  try { program.parse_args(argc, argv); } catch (const std::runtime_error &err) { JAFFAR_THROW_LOGIC("%s\n%s", err.what(), program.help().str().c_str()); }
+
+  const auto scriptFilePath = program.get<std::string>("scriptFile");
+  const auto inputSetFilePath = program.get<std::string>("inputSetFile");
+
+  const auto maxDepth = program.get<int>("--depth");
+  if (maxDepth < 1) JAFFAR_THROW_LOGIC("Invalid depth: %d\n", maxDepth);
+
+  const auto maxStates = program.get<int>("--maxStates");
+  if (maxStates < 1) JAFFAR_THROW_LOGIC("Invalid maximum state count: %d\n", maxStates);
+
+  const auto threadCount = program.get<int>("--threads");
+  if (threadCount < 1) JAFFAR_THROW_LOGIC("Invalid thread count: %d\n", threadCount);
+
+  // Loading script file
+  std::string configJsRaw;
+  if (jaffarCommon::file::loadStringFromFile(configJsRaw, scriptFilePath) == false) JAFFAR_THROW_LOGIC("Could not find/read script file: %s\n", scriptFilePath.c_str());
+  const auto configJs = nlohmann::json::parse(configJsRaw);
+
+  const auto romFilePath = jaffarCommon::json::getString(configJs, "Rom File");
+  const auto initialStateFilePath = jaffarCommon::json::getString(configJs, "Initial State File");
+  const auto stateDisabledBlocks = jaffarCommon::json::getArray<std::string>(configJs, "Disable State Blocks");
+
+  // Loading ROM File, and checking it against the expected SHA1 hash
+  const auto romSHA1 = jaffar::RomRegistry::get().load(romFilePath, jaffarCommon::json::getString(configJs, "Expected ROM SHA1"))->sha1;
+
+  // Creating the root instance, and one clone of it per thread
+  auto root = createEmuInstance(configJs, romFilePath, initialStateFilePath, stateDisabledBlocks);
+  std::vector<std::unique_ptr<libA2600Hawk::EmuInstanceBase>> instances;
+  for (int i = 0; i < threadCount; i++) instances.push_back(root->clone());
+
+  const auto stateSize = root->getStateSize();
+  std::vector<uint8_t> rootState(stateSize);
+  {
+    jaffarCommon::serializer::Contiguous s(rootState.data(), stateSize);
+    root->serializeState(s);
+  }
+
+  // Getting the input set, keeping the first occurrence of each input
+  std::string inputSetRaw;
+  if (jaffarCommon::file::loadStringFromFile(inputSetRaw, inputSetFilePath) == false) JAFFAR_THROW_LOGIC("Could not find/read input set file: %s\n", inputSetFilePath.c_str());
+  std::vector<jaffar::input_t> inputList;
+  root->getInputParser()->parseInputSequence(inputSetRaw, inputList);
+
+  std::vector<jaffar::input_t> inputs;
+  std::set<std::string> inputStrings;
+  for (const auto &input : inputList)
+    if (inputStrings.insert(root->getInputParser()->getInputString(input)).second == true) inputs.push_back(input);
+  if (inputs.empty() == true) JAFFAR_THROW_LOGIC("The input set file has no inputs: %s\n", inputSetFilePath.c_str());
+
+  printf("[] -----------------------------------------\n");
+  printf("[] Exploring Script:                       '%s'\n", scriptFilePath.c_str());
+  printf("[] Emulation Core:                         '%s'\n", root->getCoreName().c_str());
+  printf("[] ROM File:                               '%s'\n", romFilePath.c_str());
+  printf("[] ROM Hash:                               'SHA1: %s'\n", romSHA1.c_str());
+  printf("[] Input Set File:                         '%s'\n", inputSetFilePath.c_str());
+  printf("[] Input Set:                              %lu inputs\n", inputs.size());
+  for (const auto &input : inputs)
+  printf("[]   %s\n", root->getInputParser()->getInputString(input).c_str());
+  printf("[] State Size:                             %lu bytes\n", stateSize);
+  printf("[] Maximum Depth:                          %d frames\n", maxDepth);
+  printf("[] Maximum States:                         %d\n", maxStates);
+  printf("[] ********** Exploring **********\n");
+  fflush(stdout);
+
+  // Exploring with 1, 2, 4, ... threads, up to the requested number
+  std::vector<size_t> threadCounts;
+  for (size_t t = 1; t < (size_t)threadCount; t *= 2) threadCounts.push_back(t);
+  threadCounts.push_back(threadCount);
+
+  std::vector<explorationResult_t> results;
+  for (const auto threads : threadCounts)
+  {
+    results.push_back(explore(instances, threads, rootState, inputs, maxDepth, maxStates));
+
+    // The states kept at each level do not depend on how the work was split
+    const auto &result = results.back();
+    if (result.levels.size() != results[0].levels.size()) JAFFAR_THROW_RUNTIME("Exploration with %lu threads reached a different depth than with 1 thread\n", threads);
+    for (size_t depth = 0; depth < result.levels.size(); depth++)
+    {
+      if (result.levels[depth].newStates != results[0].levels[depth].newStates)
+        JAFFAR_THROW_RUNTIME("Exploration with %lu threads found %lu new states at depth %lu, but %lu with 1 thread\n", threads, result.levels[depth].newStates, depth + 1, results[0].levels[depth].newStates);
+      if (result.levels[depth].newStatesDigest != results[0].levels[depth].newStatesDigest)
+        JAFFAR_THROW_RUNTIME("Exploration with %lu threads kept different states at depth %lu than with 1 thread\n", threads, depth + 1);
+    }
+  }
+
+  // Level breakdown, for the run with the most threads
+  const auto &result = results.back();
+  printf("[] Levels (%lu Threads):\n", threadCounts.back());
+  printf("[]   %5s   %10s   %12s   %10s   %8s   %18s\n", "Depth", "Frontier", "Generated", "New", "Dedup", "States / s");
+  for (size_t depth = 0; depth < result.levels.size(); depth++)
+  {
+    const auto &level = result.levels[depth];
+  printf("[]   %5lu   %10lu   %12lu   %10lu   %7.2f%%   %18.3f\n",
+         depth + 1,
+         level.frontierSize,
+         level.generatedStates,
+         level.newStates,
+         100.0 * (1.0 - (double)level.newStates / (double)level.generatedStates),
+         (double)level.generatedStates / level.elapsedTimeSeconds);
+  }
+
+  printf("[] Explored Depth:                         %lu frames%s\n", result.levels.size(), result.stateLimitReached ? " (stopped at the state limit)" : "");
+  printf("[] Unique States:                          %lu\n", result.uniqueStates);
+  printf("[] Generated States:                       %lu\n", result.generatedStates);
+  if (result.generatedStates > 0)
+  {
+  printf("[] Dedup Ratio:                            %.2f%% of the generated states were already seen\n", 100.0 * (1.0 - (double)(result.uniqueStates - 1) / (double)result.generatedStates));
+  }
+  printf("[] Elapsed Time:                           %3.3fs\n", result.elapsedTimeSeconds);
+  printf("[] Performance:                            %.3f states / s\n", (double)result.generatedStates / result.elapsedTimeSeconds);
+
+  // Scaling across thread counts
+  if (threadCounts.size() > 1)
+  {
+    const double singleThreadPerformance = (double)results[0].generatedStates / results[0].elapsedTimeSeconds;
+  printf("[] Scaling:\n");
+  printf("[]   %7s   %18s   %8s   %10s   %10s\n", "Threads", "States / s", "Speedup", "Efficiency", "Steals");
+    for (size_t i = 0; i < threadCounts.size(); i++)
+    {
+      const double performance = (double)results[i].generatedStates / results[i].elapsedTimeSeconds;
+  printf("[]   %7lu   %18.3f   %7.2fx   %9.2f%%   %10lu\n",
+         threadCounts[i],
+         performance,
+         performance / singleThreadPerformance,
+         100.0 * performance / (singleThreadPerformance * (double)threadCounts[i]),
+         results[i].stealCount);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+// Headless frame capture
+// Streams rendered ARGB frames to a file, a named pipe, or a command ("|command"), from a writer thread so the
+// emulation loop does not wait for I/O. Frames are copied into a fixed pool of slots, and the emulation loop
+// only waits (stalls) when the writer falls behind by more than the whole pool.
+//
+// Formats:
+// - raw: headerless sequence of width * height 32-bit ARGB pixels per frame (e.g., ffmpeg -f rawvideo -pix_fmt bgra)
+// - delta: a frameHeader_t, followed by one record per frame: its payload size (uint32) and a sequence of
+//   (equal pixels to skip, differing pixels count, XORed pixels) runs against the previous frame, with
+//   varint-encoded counts. The first frame is encoded against an all-zero frame
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <jaffarCommon/exceptions.hpp>
+#include "xorDelta.hpp"
+
+namespace jaffar
+{
+
+#define _FRAME_FILE_MAGIC "A26F"
+#define _FRAME_FILE_VERSION 1
+
+struct frameHeader_t
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+};
+
+static_assert(sizeof(frameHeader_t) == 16);
+
+class FrameWriter
+{
+  public:
+
+  enum format_t { raw, delta };
+
+  FrameWriter(const std::string &outputPath, const size_t width, const size_t height, const format_t format, const size_t queueDepth = 64)
+    : _frameSize(width * height)
+    , _format(format)
+  {
+    if (queueDepth == 0) JAFFAR_THROW_LOGIC("The frame queue depth must be at least 1\n");
+
+    // Opening the output, either a file (or named pipe) or a command to pipe the frames into
+    _isPipe = outputPath.size() > 0 && outputPath[0] == '|';
+    if (_isPipe == true) _output = popen(outputPath.c_str() + 1, "w");
+    if (_isPipe == false) _output = fopen(outputPath.c_str(), "wb");
+    if (_output == nullptr) JAFFAR_THROW_LOGIC("Could not open frame capture output: %s\n", outputPath.c_str());
+
+    if (_format == delta)
+    {
+      frameHeader_t header;
+      memcpy(header.magic, _FRAME_FILE_MAGIC, sizeof(header.magic));
+      header.version = _FRAME_FILE_VERSION;
+      header.width = (uint32_t)width;
+      header.height = (uint32_t)height;
+      writeOutput(&header, sizeof(header));
+
+      _previousFrame.assign(_frameSize, 0);
+    }
+
+    // Allocating all slots upfront
+    _slots.resize(queueDepth);
+    for (size_t i = 0; i < queueDepth; i++)
+    {
+      _slots[i].resize(_frameSize);
+      _freeSlots.push_back(i);
+    }
+
+    _writer = std::thread([this]() { writerLoop(); });
+  }
+
+  ~FrameWriter()
+  {
+    if (_isFinished == false) closeOutput();
+  }
+
+  FrameWriter(const FrameWriter &) = delete;
+  FrameWriter &operator=(const FrameWriter &) = delete;
+
+  // Copies a frame and queues it for writing
+  void push(const uint32_t *frame)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_freeSlots.empty() == true)
+    {
+      _stallCount++;
+      _slotFreed.wait(lock, [this]() { return _freeSlots.empty() == false; });
+    }
+
+    const auto slot = _freeSlots.front();
+    _freeSlots.pop_front();
+    lock.unlock();
+
+    memcpy(_slots[slot].data(), frame, _frameSize * sizeof(uint32_t));
+
+    lock.lock();
+    _queuedSlots.push_back(slot);
+    _frameCount++;
+    _frameQueued.notify_one();
+  }
+
+  // Waits until every queued frame is written and closes the output
+  void finish()
+  {
+    closeOutput();
+    if (_hasWriteError == true) JAFFAR_THROW_RUNTIME("Could not write to the frame capture output\n");
+  }
+
+  size_t getFrameCount() const { return _frameCount; }
+  size_t getBytesWritten() const { return _bytesWritten; }
+  size_t getStallCount() const { return _stallCount; }
+
+  private:
+
+  void closeOutput()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _isFinished = true;
+      _frameQueued.notify_one();
+    }
+    if (_writer.joinable()) _writer.join();
+
+    if (_isPipe == true) pclose(_output);
+    if (_isPipe == false) fclose(_output);
+  }
+
+  void writerLoop()
+  {
+    std::vector<uint8_t> encodedFrame;
+
+    while (true)
+    {
+      size_t slot;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _frameQueued.wait(lock, [this]() { return _queuedSlots.empty() == false || _isFinished == true; });
+        if (_queuedSlots.empty() == true) return;
+        slot = _queuedSlots.front();
+        _queuedSlots.pop_front();
+      }
+
+      const auto &frame = _slots[slot];
+      if (_format == raw) writeOutput(frame.data(), _frameSize * sizeof(uint32_t));
+      if (_format == delta)
+      {
+        encodedFrame.clear();
+        jaffar::xorDelta::encode(_previousFrame.data(), frame.data(), _frameSize, encodedFrame);
+        const uint32_t payloadSize = (uint32_t)encodedFrame.size();
+        writeOutput(&payloadSize, sizeof(payloadSize));
+        writeOutput(encodedFrame.data(), encodedFrame.size());
+        memcpy(_previousFrame.data(), frame.data(), _frameSize * sizeof(uint32_t));
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _freeSlots.push_back(slot);
+        _slotFreed.notify_one();
+      }
+    }
+  }
+
+  // Only called from the writer thread (or the constructor, before it starts)
+  void writeOutput(const void *data, const size_t size)
+  {
+    if (_hasWriteError == true) return;
+    if (fwrite(data, 1, size, _output) != size) _hasWriteError = true;
+    _bytesWritten += size;
+  }
+
+  // Pixels per frame
+  const size_t _frameSize;
+  const format_t _format;
+
+  FILE *_output;
+  bool _isPipe;
+
+  // Frame slots, either free or queued for writing
+  std::vector<std::vector<uint32_t>> _slots;
+  std::deque<size_t> _freeSlots;
+  std::deque<size_t> _queuedSlots;
+
+  // Last written frame, for delta encoding
+  std::vector<uint32_t> _previousFrame;
+
+  std::thread _writer;
+  std::mutex _mutex;
+  std::condition_variable _frameQueued;
+  std::condition_variable _slotFreed;
+  bool _isFinished = false;
+
+  // Statistics
+  size_t _frameCount = 0;
+  size_t _stallCount = 0;
+  std::atomic<size_t> _bytesWritten{0};
+  std::atomic<bool> _hasWriteError{false};
+};
+
+} // namespace jaffar
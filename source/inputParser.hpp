@@ -7,7 +7,9 @@
 #include <jaffarCommon/exceptions.hpp>
 #include <jaffarCommon/json.hpp>
 #include <string>
+#include <string_view>
 #include <sstream>
+#include <vector>
 #include "Atari2600Controller.h"
 
 namespace jaffar
@@ -24,6 +26,14 @@ struct input_t
   bool rightDifficulty = false;
   port_t port1 = 0;
   port_t port2 = 0;
+
+  inline bool operator==(const input_t &other) const
+  {
+    return reset == other.reset && select == other.select && power == other.power && leftDifficulty == other.leftDifficulty &&
+           rightDifficulty == other.rightDifficulty && port1 == other.port1 && port2 == other.port2;
+  }
+
+  inline bool operator!=(const input_t &other) const { return !(*this == other); }
 };
 
 class InputParser
@@ -55,6 +65,8 @@ public:
       
       if (isTypeRecognized == false) JAFFAR_THROW_LOGIC("Controller 2 type not recognized: '%s'\n", controller2Type.c_str()); 
     }
+
+    updateInputStringLength();
   }
 
   inline input_t parseInputString(const std::string &inputString) const
@@ -88,16 +100,164 @@ public:
     return input;
   };
 
-  inline void setController1Type(const controller_t type) { _controller1Type = type; }
-  inline void setController2Type(const controller_t type) { _controller2Type = type; }
+  // Allocation-free version of parseInputString. Validates the fixed-length layout and decodes each field with a lookup table
+  inline input_t parseInputStringFast(const std::string_view inputString) const
+  {
+    if (inputString.size() != _inputStringLength) reportBadInputString(std::string(inputString));
+
+    const auto &tables = getParseTables();
+    const auto c = (const uint8_t *)inputString.data();
+
+    // Start separator
+    bool isValid = c[0] == '|';
+
+    // Console inputs
+    uint8_t consoleBits = 0;
+    for (size_t i = 0; i < 5; i++)
+    {
+      const auto value = tables.console[i][c[1 + i]];
+      isValid &= value >= 0;
+      consoleBits |= (value & 1) << i;
+    }
+
+    // Controller inputs
+    size_t pos = 6;
+    input_t input;
+    if (_controller1Type != controller_t::none) { isValid &= parseGamePadInputFast(input.port1, c + pos, tables); pos += 6; }
+    if (_controller2Type != controller_t::none) { isValid &= parseGamePadInputFast(input.port2, c + pos, tables); pos += 6; }
+
+    // End separator
+    isValid &= c[pos] == '|';
+
+    if (isValid == false) reportBadInputString(std::string(inputString));
+
+    input.reset = (consoleBits & 1) != 0;
+    input.select = (consoleBits & 2) != 0;
+    input.power = (consoleBits & 4) != 0;
+    input.leftDifficulty = (consoleBits & 8) != 0;
+    input.rightDifficulty = (consoleBits & 16) != 0;
+
+    return input;
+  }
+
+  // Decodes a whole whitespace-separated sequence of input strings
+  inline void parseInputSequence(const std::string_view sequence, std::vector<input_t> &inputs) const
+  {
+    inputs.reserve(inputs.size() + sequence.size() / (_inputStringLength + 1));
+
+    size_t pos = 0;
+    while (pos < sequence.size())
+    {
+      // Skipping separators
+      if (isSeparator(sequence[pos])) { pos++; continue; }
+
+      // Finding the end of the current input string
+      size_t end = pos;
+      while (end < sequence.size() && isSeparator(sequence[end]) == false) end++;
+
+      inputs.push_back(parseInputStringFast(sequence.substr(pos, end - pos)));
+      pos = end;
+    }
+  }
+
+  // Produces the input string that parses back into the given input
+  inline std::string getInputString(const input_t &input) const
+  {
+    std::string inputString = "|";
+
+    // Console inputs
+    inputString += input.reset ? 'r' : '.';
+    inputString += input.select ? 's' : '.';
+    inputString += input.power ? 'P' : '.';
+    inputString += input.leftDifficulty ? 'l' : '.';
+    inputString += input.rightDifficulty ? 'r' : '.';
+
+    // Controller inputs
+    if (_controller1Type != controller_t::none) inputString += getGamePadString(input.port1);
+    if (_controller2Type != controller_t::none) inputString += getGamePadString(input.port2);
+
+    inputString += '|';
+    return inputString;
+  }
+
+  inline void setController1Type(const controller_t type) { _controller1Type = type; updateInputStringLength(); }
+  inline void setController2Type(const controller_t type) { _controller2Type = type; updateInputStringLength(); }
 
   private:
 
+  // Per-position lookup tables for the fast parser. Each entry holds the value a character decodes to, or -1 if not allowed there
+  struct parseTables_t
+  {
+    int8_t console[5][256];
+    int32_t gamepad[5][256];
+  };
+
+  static const parseTables_t &getParseTables()
+  {
+    static const parseTables_t tables = []() {
+      parseTables_t t;
+      const char consoleChars[5] = {'r', 's', 'P', 'l', 'r'};
+      const char gamepadChars[5] = {'U', 'D', 'L', 'R', 'B'};
+      const int32_t gamepadCodes[5] = {Atari2600PortButtons::Up, Atari2600PortButtons::Down, Atari2600PortButtons::Left, Atari2600PortButtons::Right, Atari2600PortButtons::Button};
+
+      for (size_t i = 0; i < 5; i++)
+      {
+        for (size_t j = 0; j < 256; j++) t.console[i][j] = -1;
+        for (size_t j = 0; j < 256; j++) t.gamepad[i][j] = -1;
+        t.console[i][(uint8_t)'.'] = 0;
+        t.console[i][(uint8_t)consoleChars[i]] = 1;
+        t.gamepad[i][(uint8_t)'.'] = 0;
+        t.gamepad[i][(uint8_t)gamepadChars[i]] = gamepadCodes[i];
+      }
+      return t;
+    }();
+
+    return tables;
+  }
+
+  static inline bool parseGamePadInputFast(port_t &port, const uint8_t *c, const parseTables_t &tables)
+  {
+    // Controller separator
+    bool isValid = c[0] == '|';
+
+    port_t code = 0;
+    for (size_t i = 0; i < 5; i++)
+    {
+      const auto value = tables.gamepad[i][c[1 + i]];
+      isValid &= value >= 0;
+      code |= (port_t)value;
+    }
+
+    port = code;
+    return isValid;
+  }
+
+  static inline bool isSeparator(const char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+  inline void updateInputStringLength()
+  {
+    // Start separator, console inputs, and end separator, plus separator and buttons for each controller
+    _inputStringLength = 7;
+    if (_controller1Type != controller_t::none) _inputStringLength += 6;
+    if (_controller2Type != controller_t::none) _inputStringLength += 6;
+  }
+
   static inline void reportBadInputString(const std::string &inputString)
   {
     JAFFAR_THROW_LOGIC("Could not decode input string: '%s'\n", inputString.c_str());
   }
 
+  static std::string getGamePadString(const port_t code)
+  {
+    std::string gamePadString = "|";
+    gamePadString += (code & Atari2600PortButtons::Up) ? 'U' : '.';
+    gamePadString += (code & Atari2600PortButtons::Down) ? 'D' : '.';
+    gamePadString += (code & Atari2600PortButtons::Left) ? 'L' : '.';
+    gamePadString += (code & Atari2600PortButtons::Right) ? 'R' : '.';
+    gamePadString += (code & Atari2600PortButtons::Button) ? 'B' : '.';
+    return gamePadString;
+  }
+
   static void parseGamePadInput(uint16_t& code, std::istringstream& ss, const std::string &inputString)
   {
     // Currently read character
@@ -178,6 +338,9 @@ public:
 
   controller_t _controller1Type;
   controller_t _controller2Type;
+
+  // Expected length of an input string, given the controller types
+  size_t _inputStringLength;
 };
 
 } // namespace jaffar
\ No newline at end of file
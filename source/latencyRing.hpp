@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <jaffarCommon/exceptions.hpp>
+#include "percentile.hpp"
+
+namespace jaffar
+{
+
+// Fixed-capacity ring of per-step latencies. Storage is allocated upfront so recording never allocates;
+// once full, the oldest steps are overwritten
+class LatencyRing
+{
+  public:
+
+  struct entry_t
+  {
+    size_t stepId;
+    uint64_t latency;
+  };
+
+  LatencyRing(const size_t capacity) : _capacity(capacity)
+  {
+    if (_capacity == 0) JAFFAR_THROW_LOGIC("The latency ring capacity must be at least 1\n");
+    _entries.resize(_capacity);
+  }
+
+  inline void record(const size_t stepId, const uint64_t latency)
+  {
+    _entries[_recordCount % _capacity] = entry_t{stepId, latency};
+    _recordCount++;
+  }
+
+  void clear() { _recordCount = 0; }
+
+  // Number of entries currently held
+  size_t size() const { return std::min(_recordCount, _capacity); }
+
+  // Latency at the given percentile (0.0 - 1.0) of the held entries
+  uint64_t getPercentile(const double percentile) const
+  {
+    std::vector<uint64_t> latencies(size());
+    for (size_t i = 0; i < latencies.size(); i++) latencies[i] = _entries[i].latency;
+    return selectPercentile(latencies, percentile);
+  }
+
+  uint64_t getMax() const
+  {
+    uint64_t max = 0;
+    for (size_t i = 0; i < size(); i++) max = std::max(max, _entries[i].latency);
+    return max;
+  }
+
+  // The given number of most expensive steps, most expensive first
+  std::vector<entry_t> getWorst(const size_t count) const
+  {
+    std::vector<entry_t> entries(_entries.begin(), _entries.begin() + size());
+    const size_t worstCount = std::min(count, entries.size());
+    std::partial_sort(entries.begin(), entries.begin() + worstCount, entries.end(), [](const entry_t &a, const entry_t &b) { return a.latency > b.latency; });
+    entries.resize(worstCount);
+    return entries;
+  }
+
+  private:
+
+  const size_t _capacity;
+  std::vector<entry_t> _entries;
+  size_t _recordCount = 0;
+};
+
+} // namespace jaffar
@@ -0,0 +1,63 @@
+#include "argparse/argparse.hpp"
+#include <jaffarCommon/json.hpp>
+#include <jaffarCommon/file.hpp>
+#include <jaffarCommon/exceptions.hpp>
+#include "inputParser.hpp"
+#include "movieFile.hpp"
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+  // Parsing command line arguments
+  argparse::ArgumentParser program("movieConverter", "1.0");
+
+  program.add_argument("scriptFile")
+    .help("Path to the test script file, used to get the controller types.")
+    .required();
+
+  program.add_argument("sequenceFile")
+    .help("Path to the input sequence file (.sol) to convert.")
+    .required();
+
+  program.add_argument("outputFile")
+    .help("Path to write the binary movie file to.")
+    .required();
+
+  // Try to parse arguments
+  try { program.parse_args(argc, argv); } catch (const std::runtime_error &err) { JAFFAR_THROW_LOGIC("%s\n%s", err.what(), program.help().str().c_str()); }
+
+  // Getting file paths
+  const auto scriptFilePath = program.get<std::string>("scriptFile");
+  const auto sequenceFilePath = program.get<std::string>("sequenceFile");
+  const auto outputFilePath = program.get<std::string>("outputFile");
+
+  // Loading script file
+  std::string configJsRaw;
+  if (jaffarCommon::file::loadStringFromFile(configJsRaw, scriptFilePath) == false) JAFFAR_THROW_LOGIC("Could not find/read script file: %s\n", scriptFilePath.c_str());
+
+  // Parsing script
+  const auto configJs = nlohmann::json::parse(configJsRaw);
+
+  // Creating input parser for the script's controller types
+  jaffar::InputParser inputParser(configJs);
+
+  // Loading sequence file
+  std::string sequenceRaw;
+  if (jaffarCommon::file::loadStringFromFile(sequenceRaw, sequenceFilePath) == false) JAFFAR_THROW_LOGIC("[ERROR] Could not find or read from input sequence file: %s\n", sequenceFilePath.c_str());
+
+  // Decoding sequence
+  std::vector<jaffar::input_t> decodedSequence;
+  inputParser.parseInputSequence(sequenceRaw, decodedSequence);
+
+  // Saving binary movie
+  if (jaffar::MovieFile::save(decodedSequence, outputFilePath) == false) JAFFAR_THROW_LOGIC("Could not write movie file: %s\n", outputFilePath.c_str());
+
+  printf("[] Converted %lu inputs from '%s' to '%s' (%lu bytes)\n",
+         decodedSequence.size(),
+         sequenceFilePath.c_str(),
+         outputFilePath.c_str(),
+         sizeof(jaffar::movieHeader_t) + decodedSequence.size() * sizeof(jaffar::packedInput_t));
+
+  return 0;
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+// Binary input movie format
+// Stores a fixed header followed by one packed 3-byte record per frame, so a movie can be
+// memory-mapped and decoded without any string parsing
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <jaffarCommon/exceptions.hpp>
+#include <jaffarCommon/file.hpp>
+#include "inputParser.hpp"
+
+namespace jaffar
+{
+
+#define _MOVIE_FILE_MAGIC "A26M"
+#define _MOVIE_FILE_VERSION 1
+
+struct movieHeader_t
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t frameCount;
+};
+
+// Console buttons and the UDLRB state of each port, one bit each
+struct packedInput_t
+{
+  uint8_t console;
+  uint8_t port1;
+  uint8_t port2;
+};
+
+static_assert(sizeof(movieHeader_t) == 16);
+static_assert(sizeof(packedInput_t) == 3);
+
+class MovieFile
+{
+  public:
+
+  // Memory-maps a movie file for reading. If it is not a valid movie, it is unmapped and closed before throwing
+  MovieFile(const std::string &filePath)
+  {
+    try { mapFile(filePath); }
+    catch (...)
+    {
+      release();
+      throw;
+    }
+  }
+
+  ~MovieFile() { release(); }
+
+  MovieFile(const MovieFile &) = delete;
+  MovieFile &operator=(const MovieFile &) = delete;
+
+  inline size_t size() const { return _frameCount; }
+
+  inline input_t getInput(const size_t frame) const { return unpackInput(_records[frame]); }
+
+  // Decodes every frame into the given vector
+  void decode(std::vector<input_t> &inputs) const
+  {
+    inputs.resize(_frameCount);
+    for (size_t i = 0; i < _frameCount; i++) inputs[i] = unpackInput(_records[i]);
+  }
+
+  // Checks whether a file starts with the binary movie signature
+  static bool isMovieFile(const std::string &filePath)
+  {
+    char magic[4];
+    const int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    const auto bytesRead = read(fd, magic, sizeof(magic));
+    close(fd);
+    return bytesRead == sizeof(magic) && memcmp(magic, _MOVIE_FILE_MAGIC, sizeof(magic)) == 0;
+  }
+
+  // Writes the given inputs as a binary movie file
+  static bool save(const std::vector<input_t> &inputs, const std::string &filePath)
+  {
+    std::string data;
+    data.resize(sizeof(movieHeader_t) + inputs.size() * sizeof(packedInput_t));
+
+    movieHeader_t header;
+    memcpy(header.magic, _MOVIE_FILE_MAGIC, sizeof(header.magic));
+    header.version = _MOVIE_FILE_VERSION;
+    header.frameCount = inputs.size();
+    memcpy(data.data(), &header, sizeof(movieHeader_t));
+
+    auto records = (packedInput_t *)(data.data() + sizeof(movieHeader_t));
+    for (size_t i = 0; i < inputs.size(); i++) records[i] = packInput(inputs[i]);
+
+    return jaffarCommon::file::saveStringToFile(data, filePath);
+  }
+
+  static inline packedInput_t packInput(const input_t &input)
+  {
+    packedInput_t packed;
+    packed.console = (uint8_t)((input.reset ? 1 : 0) | (input.select ? 2 : 0) | (input.power ? 4 : 0) | (input.leftDifficulty ? 8 : 0) | (input.rightDifficulty ? 16 : 0));
+    packed.port1 = packPort(input.port1);
+    packed.port2 = packPort(input.port2);
+    return packed;
+  }
+
+  static inline input_t unpackInput(const packedInput_t &packed)
+  {
+    input_t input;
+    input.reset = (packed.console & 1) != 0;
+    input.select = (packed.console & 2) != 0;
+    input.power = (packed.console & 4) != 0;
+    input.leftDifficulty = (packed.console & 8) != 0;
+    input.rightDifficulty = (packed.console & 16) != 0;
+    input.port1 = unpackPort(packed.port1);
+    input.port2 = unpackPort(packed.port2);
+    return input;
+  }
+
+  private:
+
+  static inline uint8_t packPort(const port_t port)
+  {
+    uint8_t packed = 0;
+    if (port & Atari2600PortButtons::Up) packed |= 1;
+    if (port & Atari2600PortButtons::Down) packed |= 2;
+    if (port & Atari2600PortButtons::Left) packed |= 4;
+    if (port & Atari2600PortButtons::Right) packed |= 8;
+    if (port & Atari2600PortButtons::Button) packed |= 16;
+    return packed;
+  }
+
+  static inline port_t unpackPort(const uint8_t packed)
+  {
+    port_t port = 0;
+    if (packed & 1) port |= Atari2600PortButtons::Up;
+    if (packed & 2) port |= Atari2600PortButtons::Down;
+    if (packed & 4) port |= Atari2600PortButtons::Left;
+    if (packed & 8) port |= Atari2600PortButtons::Right;
+    if (packed & 16) port |= Atari2600PortButtons::Button;
+    return port;
+  }
+
+  // Opens, maps and validates the file. On failure, whatever was opened is left for release()
+  void mapFile(const std::string &filePath)
+  {
+    _fd = open(filePath.c_str(), O_RDONLY);
+    if (_fd < 0) JAFFAR_THROW_LOGIC("Could not open movie file: %s\n", filePath.c_str());
+
+    struct stat fileStat;
+    if (fstat(_fd, &fileStat) != 0) JAFFAR_THROW_LOGIC("Could not get size of movie file: %s\n", filePath.c_str());
+    _fileSize = fileStat.st_size;
+    if (_fileSize < sizeof(movieHeader_t)) JAFFAR_THROW_LOGIC("Movie file too small: %s\n", filePath.c_str());
+
+    const auto data = mmap(nullptr, _fileSize, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED) JAFFAR_THROW_LOGIC("Could not map movie file: %s\n", filePath.c_str());
+    _data = (uint8_t *)data;
+    madvise(_data, _fileSize, MADV_SEQUENTIAL);
+
+    // Validating header
+    const auto header = (const movieHeader_t *)_data;
+    if (memcmp(header->magic, _MOVIE_FILE_MAGIC, sizeof(header->magic)) != 0) JAFFAR_THROW_LOGIC("Not a binary movie file: %s\n", filePath.c_str());
+    if (header->version != _MOVIE_FILE_VERSION) JAFFAR_THROW_LOGIC("Unsupported movie file version %u in %s\n", header->version, filePath.c_str());
+    if (sizeof(movieHeader_t) + header->frameCount * sizeof(packedInput_t) != _fileSize)
+      JAFFAR_THROW_LOGIC("Movie file size does not match its frame count (%lu): %s\n", header->frameCount, filePath.c_str());
+
+    _frameCount = header->frameCount;
+    _records = (const packedInput_t *)(_data + sizeof(movieHeader_t));
+  }
+
+  void release()
+  {
+    if (_data != nullptr) munmap(_data, _fileSize);
+    if (_fd >= 0) close(_fd);
+    _data = nullptr;
+    _fd = -1;
+  }
+
+  int _fd = -1;
+  size_t _fileSize = 0;
+  uint8_t *_data = nullptr;
+  size_t _frameCount;
+  const packedInput_t *_records;
+};
+
+} // namespace jaffar
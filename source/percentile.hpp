@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace jaffar
+{
+
+// Index of the sample at the given percentile (0.0 - 1.0) among sampleCount sorted samples
+inline size_t getPercentileIndex(const size_t sampleCount, const double percentile)
+{
+  return std::min(sampleCount - 1, (size_t)(percentile * (double)sampleCount));
+}
+
+// Sample at the given percentile of a sorted set of samples, or 0 if there are none
+inline uint64_t getSortedPercentile(const std::vector<uint64_t> &sortedSamples, const double percentile)
+{
+  if (sortedSamples.empty()) return 0;
+  return sortedSamples[getPercentileIndex(sortedSamples.size(), percentile)];
+}
+
+// Sample at the given percentile of an unsorted set of samples, or 0 if there are none. Partially reorders the samples
+inline uint64_t selectPercentile(std::vector<uint64_t> &samples, const double percentile)
+{
+  if (samples.empty()) return 0;
+  const size_t index = getPercentileIndex(samples.size(), percentile);
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+} // namespace jaffar
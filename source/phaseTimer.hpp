@@ -0,0 +1,120 @@
+#pragma once
+
+// Per-phase timing of the emulation cycle
+// Each timed statement adds a sample to its phase. Timing is only compiled in when _PHASE_TIMING is defined
+// (meson option 'phaseTiming'). Otherwise, _PHASE_TIMED runs the statement as is, and nothing is recorded
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <jaffarCommon/json.hpp>
+#include "percentile.hpp"
+
+#ifdef _PHASE_TIMING
+  #define _PHASE_TIMED(timer, phase, ...) { const auto _phaseStart = jaffar::PhaseTimer::now(); __VA_ARGS__; if ((timer) != nullptr) (timer)->record(phase, jaffar::PhaseTimer::now() - _phaseStart); }
+#else
+  #define _PHASE_TIMED(timer, phase, ...) { __VA_ARGS__; }
+#endif
+
+// Number of power-of-two histogram buckets, covering up to ~1 second per sample
+#define _PHASE_HISTOGRAM_BUCKETS 30
+
+namespace jaffar
+{
+
+class PhaseTimer
+{
+  public:
+
+  enum phase_t { advance, deserialize, serialize, hash, phaseCount };
+
+  struct summary_t
+  {
+    size_t count;
+    double totalSeconds;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+    std::vector<size_t> histogram;
+  };
+
+  // Preallocates room for the expected number of samples per phase, so recording does not allocate
+  PhaseTimer(const size_t expectedSamples)
+  {
+    for (auto &samples : _samples) samples.reserve(expectedSamples);
+  }
+
+  static inline std::chrono::steady_clock::time_point now() { return std::chrono::steady_clock::now(); }
+
+  inline void record(const phase_t phase, const std::chrono::steady_clock::duration elapsed)
+  {
+    _samples[phase].push_back((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+
+  static const char *getPhaseName(const phase_t phase)
+  {
+    if (phase == advance) return "Advance";
+    if (phase == deserialize) return "Deserialize";
+    if (phase == serialize) return "Serialize";
+    return "Hash";
+  }
+
+  // Computes the statistics of a phase, in nanoseconds. Histogram bucket i counts the samples in [2^i, 2^(i+1)) ns
+  summary_t getSummary(const phase_t phase) const
+  {
+    summary_t summary;
+    auto samples = _samples[phase];
+    summary.count = samples.size();
+    summary.histogram.assign(_PHASE_HISTOGRAM_BUCKETS, 0);
+
+    uint64_t total = 0;
+    for (const auto sample : samples)
+    {
+      total += sample;
+      size_t bucket = 0;
+      while (bucket < _PHASE_HISTOGRAM_BUCKETS - 1 && (sample >> (bucket + 1)) != 0) bucket++;
+      summary.histogram[bucket]++;
+    }
+    summary.totalSeconds = (double)total * 1.0e-9;
+
+    std::sort(samples.begin(), samples.end());
+    summary.mean = samples.empty() ? 0 : total / samples.size();
+    summary.p50 = getSortedPercentile(samples, 0.50);
+    summary.p90 = getSortedPercentile(samples, 0.90);
+    summary.p99 = getSortedPercentile(samples, 0.99);
+    summary.max = samples.empty() ? 0 : samples.back();
+    return summary;
+  }
+
+  // Builds the machine-readable report for all phases that have samples
+  nlohmann::json getReport() const
+  {
+    nlohmann::json report;
+    for (size_t phase = 0; phase < phaseCount; phase++)
+    {
+      const auto summary = getSummary((phase_t)phase);
+      if (summary.count == 0) continue;
+
+      auto &phaseJs = report[getPhaseName((phase_t)phase)];
+      phaseJs["Count"] = summary.count;
+      phaseJs["Total Seconds"] = summary.totalSeconds;
+      phaseJs["Mean Ns"] = summary.mean;
+      phaseJs["P50 Ns"] = summary.p50;
+      phaseJs["P90 Ns"] = summary.p90;
+      phaseJs["P99 Ns"] = summary.p99;
+      phaseJs["Max Ns"] = summary.max;
+      phaseJs["Histogram (Log2 Ns)"] = summary.histogram;
+    }
+    return report;
+  }
+
+  private:
+
+  std::vector<uint64_t> _samples[phaseCount];
+};
+
+} // namespace jaffar
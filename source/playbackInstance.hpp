@@ -1,16 +1,24 @@
 #pragma once
 
 #include "a2600HawkInstance.hpp"
+#include "stateStore.hpp"
+#include "statePool.hpp"
 #include <string>
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include <jaffarCommon/hash.hpp>
 #include <jaffarCommon/exceptions.hpp>
 
+// Time to hold each frame during playback, in microseconds
 #define _INVERSE_FRAME_RATE 66667
 
+// Number of steps the background worker materializes each time it takes the emulator
+#define _BACKGROUND_CHUNK_SIZE 16
+
 struct stepData_t
 {
   std::string input;
-  uint8_t *stateData;
   jaffarCommon::hash::hash_t hash;
 };
 
@@ -18,87 +26,77 @@ class PlaybackInstance
 {
   public:
 
-  // Initializes the playback module instance
-  PlaybackInstance(libA2600Hawk::EmuInstance *emu, const std::vector<std::string> &sequence, const std::string& cycleType) :
-   _emu(emu)
+  // Initializes the playback module instance. In incremental mode, steps are only emulated when requested,
+  // while a background worker fills in the rest of the sequence
+  PlaybackInstance(libA2600Hawk::EmuInstance *emu,
+                   const std::vector<std::string> &sequence,
+                   const std::string& cycleType,
+                   const size_t keyframeInterval = 64,
+                   const size_t stateCacheSize = 256,
+                   const bool isIncremental = false) :
+   _sequence(sequence),
+   _cycleType(cycleType),
+   _emu(emu),
+   _statePool(emu->getStateSize()),
+   _stateStore(_statePool, keyframeInterval, stateCacheSize)
   {
-    
-    // Getting input parser from the emulator
-    const auto inputParser = emu->getInputParser();
-
     // Getting full state size
-    _fullStateSize = _emu->getStateSize();  
+    _fullStateSize = _emu->getStateSize();
 
-    // Allocating temporary state data 
-    uint8_t* stateData = (uint8_t*)malloc(_fullStateSize);
+    // The sequence has one step per input, plus the final state
+    _totalSteps = _sequence.size() + 1;
 
-    // Building sequence information
-    for (size_t i = 0; i < sequence.size(); i++)
-    {
-      // Adding new step
-      stepData_t step;
-      step.input = sequence[i];
-      auto stepIdx = inputParser->parseInputString(step.input);
+    // Getting state buffers
+    _frontierState = _statePool.acquire();
+    _stepState = _statePool.acquire();
 
-      // Serializing state
-      jaffarCommon::serializer::Contiguous s(stateData, _fullStateSize);
+    // The frontier starts at the emulator's current state
+    {
+      jaffarCommon::serializer::Contiguous s(_frontierState, _fullStateSize);
       _emu->serializeState(s);
-      step.hash = _emu->getStateHash();
-
-      // Saving step data
-      step.stateData = (uint8_t *)malloc(_fullStateSize);
-      memcpy(step.stateData, stateData, _fullStateSize);
-
-      // Adding the step into the sequence
-      _stepSequence.push_back(step);
-
-      // We advance depending on cycle type
-      if (cycleType == "Simple")
-      {
-        _emu->advanceState(stepIdx);
-      }
-
-      if (cycleType == "Rerecord")
-      {
-        _emu->advanceState(stepIdx);
-        jaffarCommon::deserializer::Contiguous d(stateData, _fullStateSize);
-        _emu->deserializeState(d);
-        _emu->advanceState(stepIdx);
-      }
     }
 
-    // Adding last step with no input
-    stepData_t step;
-    step.input = "<End Of Sequence>";
-    step.stateData = (uint8_t *)malloc(_fullStateSize);
-    jaffarCommon::serializer::Contiguous s(step.stateData, _fullStateSize);
+    // If not incremental, build the whole sequence now
+    if (isIncremental == false) { materializeSteps(_totalSteps); return; }
 
-    _emu->serializeState(s);
-    step.hash = _emu->getStateHash();
+    // Otherwise, only the first step is needed to start
+    materializeSteps(1);
+    _worker = std::thread([this]() { backgroundWorker(); });
+  }
 
-    // Adding the step into the sequence
-    _stepSequence.push_back(step);
+  ~PlaybackInstance()
+  {
+    stopBackgroundWorker();
 
-    // Freeing memory
-    free(stateData);
+    _statePool.release(_frontierState);
+    _statePool.release(_stepState);
+  }
+
+  // Stops background materialization, releasing the emulator for exclusive use
+  void stopBackgroundWorker()
+  {
+    _stopWorker = true;
+    if (_worker.joinable()) _worker.join();
   }
 
   // Function to render frame
   void renderFrame(const size_t stepId)
   {
-    // Checking the required step id does not exceed contents of the sequence
-    if (stepId > _stepSequence.size()) JAFFAR_THROW_RUNTIME("[Error] Attempting to render a step larger than the step sequence");
+    std::lock_guard<std::mutex> lock(_mutex);
 
     // Else we load the requested step
-    const auto stateData = getStateData(stepId);
+    const auto stateData = getStateDataImpl(stepId);
 
     {
      jaffarCommon::deserializer::Contiguous d(stateData, _fullStateSize);
      _emu->deserializeState(d);
     }
 
+    // Only this advance renders, so materialization (possibly in the background worker) never touches the window
+    _emu->enableRendering();
     _emu->advanceState(jaffar::input_t());
-    
+    _emu->disableRendering();
+
     {
      jaffarCommon::deserializer::Contiguous d(stateData, _fullStateSize);
      _emu->deserializeState(d);
@@ -108,61 +106,190 @@ class PlaybackInstance
     _emu->updateRenderer();
   }
 
+  // Copies the work RAM contents at the given step
+  void getStateWorkRam(const size_t stepId, uint8_t *buffer)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const auto stateData = getStateDataImpl(stepId);
+    jaffarCommon::deserializer::Contiguous d(stateData, _fullStateSize);
+    _emu->deserializeState(d);
+    _emu->getWorkRam(buffer);
+  }
+
   size_t getSequenceLength() const
   {
-    return _stepSequence.size();
+    return _totalSteps;
   }
 
-  const std::string getInput(const size_t stepId) const
+  // Number of steps emulated so far
+  size_t getMaterializedStepCount() const
   {
-    // Checking the required step id does not exceed contents of the sequence
-    if (stepId > _stepSequence.size()) JAFFAR_THROW_RUNTIME("[Error] Attempting to render a step larger than the step sequence");
+    return _materializedSteps;
+  }
+
+  const std::string getInput(const size_t stepId)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
 
     // Getting step information
-    const auto &step = _stepSequence[stepId];
+    const auto &step = getStep(stepId);
 
     // Returning step input
     return step.input;
   }
 
-  const uint8_t *getStateData(const size_t stepId) const
+  // Returns the state data for the given step. The pointer remains valid until the next call
+  const uint8_t *getStateData(const size_t stepId)
   {
-    // Checking the required step id does not exceed contents of the sequence
-    if (stepId > _stepSequence.size()) JAFFAR_THROW_RUNTIME("[Error] Attempting to render a step larger than the step sequence");
+    std::lock_guard<std::mutex> lock(_mutex);
+    return getStateDataImpl(stepId);
+  }
 
-    // Getting step information
-    const auto &step = _stepSequence[stepId];
+  // Gets a snapshot of the state store statistics
+  StateStore::statistics_t getStateStoreStatistics()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stateStore.getStatistics();
+  }
 
-    // Returning step input
-    return step.stateData;
+  // Gets a snapshot of the state buffer pool statistics
+  jaffar::StatePool::statistics_t getStatePoolStatistics()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _statePool.getStatistics();
   }
 
-  const jaffarCommon::hash::hash_t getStateHash(const size_t stepId) const
+  const jaffarCommon::hash::hash_t getStateHash(const size_t stepId)
   {
-    // Checking the required step id does not exceed contents of the sequence
-    if (stepId > _stepSequence.size()) JAFFAR_THROW_RUNTIME("[Error] Attempting to render a step larger than the step sequence");
+    std::lock_guard<std::mutex> lock(_mutex);
 
     // Getting step information
-    const auto &step = _stepSequence[stepId];
+    const auto &step = getStep(stepId);
 
     // Returning step input
     return step.hash;
   }
 
-  const std::string getStateInput(const size_t stepId) const
+  const std::string getStateInput(const size_t stepId)
   {
-    // Checking the required step id does not exceed contents of the sequence
-    if (stepId > _stepSequence.size()) JAFFAR_THROW_RUNTIME("[Error] Attempting to render a step larger than the step sequence");
+    std::lock_guard<std::mutex> lock(_mutex);
 
     // Getting step information
-    const auto &step = _stepSequence[stepId];
+    const auto &step = getStep(stepId);
 
     // Returning step input
     return step.input;
   }
 
   private:
-  
+
+  // The following functions require the mutex to be held
+
+  const stepData_t &getStep(const size_t stepId)
+  {
+    // Checking the required step id does not exceed contents of the sequence
+    if (stepId >= _totalSteps) JAFFAR_THROW_RUNTIME("[Error] Attempting to access a step larger than the step sequence");
+
+    // Emulating up to the requested step, if not yet there
+    if (stepId >= _stepSequence.size()) materializeSteps(stepId + 1);
+
+    return _stepSequence[stepId];
+  }
+
+  const uint8_t *getStateDataImpl(const size_t stepId)
+  {
+    // Making sure the step is materialized
+    getStep(stepId);
+
+    // Decoding state from the store, starting from its closest keyframe
+    return _stateStore.get(stepId);
+  }
+
+  // Emulates from the frontier until the given number of steps are stored
+  void materializeSteps(const size_t targetSteps)
+  {
+    if (_stepSequence.size() >= targetSteps) return;
+
+    // Resuming from the frontier, since the emulator may have been used to render other steps
+    {
+      jaffarCommon::deserializer::Contiguous d(_frontierState, _fullStateSize);
+      _emu->deserializeState(d);
+    }
+
+    while (_stepSequence.size() < targetSteps && _stepSequence.size() < _totalSteps) materializeNextStep();
+
+    // Saving the new frontier
+    {
+      jaffarCommon::serializer::Contiguous s(_frontierState, _fullStateSize);
+      _emu->serializeState(s);
+    }
+
+    _materializedSteps = _stepSequence.size();
+  }
+
+  // Stores the emulator's current state as the next step, and advances it with that step's input
+  void materializeNextStep()
+  {
+    const size_t stepId = _stepSequence.size();
+    const bool isLastStep = stepId == _sequence.size();
+
+    // Adding new step
+    stepData_t step;
+    step.input = isLastStep ? "<End Of Sequence>" : _sequence[stepId];
+
+    // Serializing state
+    jaffarCommon::serializer::Contiguous s(_stepState, _fullStateSize);
+    _emu->serializeState(s);
+    step.hash = _emu->getStateHash();
+
+    // Saving step data
+    _stateStore.push(_stepState);
+
+    // Adding the step into the sequence
+    _stepSequence.push_back(step);
+
+    // There is no input after the last step
+    if (isLastStep) return;
+
+    // We advance depending on cycle type
+    const auto input = _emu->getInputParser()->parseInputStringFast(step.input);
+
+    if (_cycleType == "Simple")
+    {
+      _emu->advanceState(input);
+    }
+
+    if (_cycleType == "Rerecord")
+    {
+      _emu->advanceState(input);
+      jaffarCommon::deserializer::Contiguous d(_stepState, _fullStateSize);
+      _emu->deserializeState(d);
+      _emu->advanceState(input);
+    }
+  }
+
+  // Fills in the rest of the sequence in small chunks, so the player can use the emulator in between
+  void backgroundWorker()
+  {
+    while (_stopWorker == false)
+    {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stepSequence.size() == _totalSteps) return;
+        materializeSteps(_stepSequence.size() + _BACKGROUND_CHUNK_SIZE);
+      }
+
+      std::this_thread::yield();
+    }
+  }
+
+  // Input sequence
+  const std::vector<std::string> _sequence;
+
+  // Emulation cycle to perform per step
+  const std::string _cycleType;
+
   // Internal sequence information
   std::vector<stepData_t> _stepSequence;
 
@@ -171,4 +298,27 @@ class PlaybackInstance
 
   // Full size of the game state
   size_t _fullStateSize;
+
+  // Pool for every full-size state buffer. Must outlive the state store
+  jaffar::StatePool _statePool;
+
+  // Keyframe and delta storage for the state of each step
+  StateStore _stateStore;
+
+  // Total number of steps, including the final state
+  size_t _totalSteps;
+
+  // State right after the last materialized step
+  uint8_t *_frontierState;
+
+  // Temporary buffer for the state of the step being materialized
+  uint8_t *_stepState;
+
+  // Guards the emulator, the step sequence and the state store
+  std::mutex _mutex;
+
+  // Background materialization
+  std::thread _worker;
+  std::atomic<bool> _stopWorker{false};
+  std::atomic<size_t> _materializedSteps{0};
 };
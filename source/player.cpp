@@ -6,6 +6,10 @@
 #include "argparse/argparse.hpp"
 #include "a2600HawkInstance.hpp"
 #include "playbackInstance.hpp"
+#include "romRegistry.hpp"
+#include "movieFile.hpp"
+#include <chrono>
+#include <thread>
 
 int main(int argc, char *argv[])
 {
@@ -17,7 +21,7 @@ int main(int argc, char *argv[])
     .required();
 
   program.add_argument("sequenceFile")
-    .help("Path to the input sequence file (.sol) to reproduce.")
+    .help("Path to the input sequence file (.sol or binary movie) to reproduce.")
     .required();
 
   program.add_argument("--reproduce")
@@ -34,6 +38,21 @@ int main(int argc, char *argv[])
     .default_value(false)
     .implicit_value(true);
 
+  program.add_argument("--incremental")
+    .help("Only emulate steps as they are requested, and generate the rest of the sequence in the background.")
+    .default_value(false)
+    .implicit_value(true);
+
+  program.add_argument("--keyframeInterval")
+    .help("Number of steps between full state copies in the step store. The steps in between are stored as deltas.")
+    .default_value(64)
+    .scan<'i', int>();
+
+  program.add_argument("--stateCacheSize")
+    .help("Number of decoded states to keep cached in the step store.")
+    .default_value(256)
+    .scan<'i', int>();
+
 
   // Try to parse arguments
   try { program.parse_args(argc, argv); } catch (const std::runtime_error &err) { JAFFAR_THROW_LOGIC("%s\n%s", err.what(), program.help().str().c_str()); }
@@ -80,17 +99,38 @@ int main(int argc, char *argv[])
 
   // Getting reproduce flag
   bool isReproduce = program.get<bool>("--reproduce");
+  const bool exitAfterReproduce = isReproduce;
 
   // Getting reproduce flag
   bool disableRender = program.get<bool>("--disableRender");
 
-  // Loading sequence file
-  std::string inputSequence;
-  auto status = jaffarCommon::file::loadStringFromFile(inputSequence, sequenceFilePath.c_str());
-  if (status == false) JAFFAR_THROW_LOGIC("[ERROR] Could not find or read from sequence file: %s\n", sequenceFilePath.c_str());
+  // Getting incremental flag
+  bool isIncremental = program.get<bool>("--incremental");
+
+  // Getting step store configuration
+  const auto keyframeInterval = program.get<int>("--keyframeInterval");
+  const auto stateCacheSize = program.get<int>("--stateCacheSize");
+  if (keyframeInterval < 1) JAFFAR_THROW_LOGIC("Invalid keyframe interval: %d\n", keyframeInterval);
+  if (stateCacheSize < 1) JAFFAR_THROW_LOGIC("Invalid state cache size: %d\n", stateCacheSize);
 
   // Building sequence information
-  const auto sequence = jaffarCommon::string::split(inputSequence, ' ');
+  std::vector<std::string> sequence;
+
+  // Binary movies are converted back to input strings for display
+  if (jaffar::MovieFile::isMovieFile(sequenceFilePath) == true)
+  {
+    jaffar::InputParser inputParser(configJs);
+    jaffar::MovieFile movieFile(sequenceFilePath);
+    for (size_t i = 0; i < movieFile.size(); i++) sequence.push_back(inputParser.getInputString(movieFile.getInput(i)));
+  }
+  else
+  {
+    // Loading sequence file
+    std::string inputSequence;
+    auto status = jaffarCommon::file::loadStringFromFile(inputSequence, sequenceFilePath.c_str());
+    if (status == false) JAFFAR_THROW_LOGIC("[ERROR] Could not find or read from sequence file: %s\n", sequenceFilePath.c_str());
+    sequence = jaffarCommon::string::split(inputSequence, ' ');
+  }
 
   // Initializing terminal
   jaffarCommon::logger::initializeTerminal();
@@ -110,26 +150,16 @@ int main(int argc, char *argv[])
   // Initializing emulator instance
   e.initialize();
 
-  // Loading ROM File
-  std::string romFileData;
-  if (jaffarCommon::file::loadStringFromFile(romFileData, romFilePath) == false) JAFFAR_THROW_LOGIC("Could not rom file: %s\n", romFilePath.c_str());
+  // Loading ROM File, checking it with the expected SHA1 hash first. The instance gets the same image from the registry
+  jaffar::RomRegistry::get().load(romFilePath, expectedROMSHA1);
   e.loadROM(romFilePath);
 
-  // If rendering enabled, then initailize it now
-  if (disableRender == false) e.enableRendering();
-  
-  // Initializing video output
+  // Initializing video output. Rendering itself is only enabled by the playback instance while rendering a frame
   if (disableRender == false) e.initializeVideoOutput();
 
   // Disabling requested blocks from state serialization
   for (const auto& block : stateDisabledBlocks) e.disableStateBlock(block);
 
-  // Calculating ROM SHA1
-  auto romSHA1 = jaffarCommon::hash::getSHA1String(romFileData);
-
-  // Checking with the expected SHA1 hash
-  if (romSHA1 != expectedROMSHA1) JAFFAR_THROW_LOGIC("Wrong ROM SHA1. Found: '%s', Expected: '%s'\n", romSHA1.c_str(), expectedROMSHA1.c_str());
-
   // If an initial state is provided, load it now
   if (initialStateFilePath != "")
   {
@@ -140,7 +170,7 @@ int main(int argc, char *argv[])
   }
 
   // Creating playback instance
-  auto p = PlaybackInstance(&e, sequence, cycleType);
+  auto p = PlaybackInstance(&e, sequence, cycleType, keyframeInterval, stateCacheSize, isIncremental);
 
   // Getting state size
   auto stateSize = e.getStateSize();
@@ -155,6 +185,10 @@ int main(int argc, char *argv[])
   // Flag to display frame information
   bool showFrameInfo = true;
 
+  // Frame pacing for reproduce mode
+  auto nextFrameTime = std::chrono::steady_clock::now();
+  size_t lateFrameCount = 0;
+
   // Interactive section
   while (continueRunning)
   {
@@ -179,16 +213,26 @@ int main(int argc, char *argv[])
       jaffarCommon::logger::log("[] Current Step #: %lu / %lu\n", currentStep + 1, sequenceLength);
       jaffarCommon::logger::log("[] Input:          %s\n", input.c_str());
       jaffarCommon::logger::log("[] State Hash:     0x%lX%lX\n", hash.first, hash.second);
+      const auto storeStatistics = p.getStateStoreStatistics();
+      jaffarCommon::logger::log("[] Step Store:     %lu KB resident (%lu KB uncompressed)\n", storeStatistics.residentBytes / 1024, storeStatistics.uncompressedBytes / 1024);
+      jaffarCommon::logger::log("[] Decode Time:    %.3f us (last) / %.3f us (average)\n", (double)storeStatistics.lastDecodeTime * 1.0e-3, storeStatistics.averageDecodeTime * 1.0e-3);
+      const auto poolStatistics = p.getStatePoolStatistics();
+      jaffarCommon::logger::log("[] State Pool:     %lu buffers in use, %lu KB reserved in %lu allocations (RSS: %lu KB)\n", poolStatistics.buffersInUse, poolStatistics.reservedBytes / 1024, poolStatistics.systemAllocationCount, jaffar::getResidentSetSize() / 1024);
+      jaffarCommon::logger::log("[] Materialized:   %lu / %lu steps\n", p.getMaterializedStepCount(), sequenceLength);
       jaffarCommon::logger::log("[] Memory Contents:\n");
+      uint8_t workRam[_WORK_RAM_SIZE];
+      p.getStateWorkRam(currentStep, workRam);
       for (int i = 0; i < 8; i++)
       {
        for (int j = 0; j < 16; j++)
        {
-        jaffarCommon::logger::log("%02X ", e.getWorkRamByte(i*16 + j));
+        jaffarCommon::logger::log("%02X ", workRam[i*16 + j]);
        }
        jaffarCommon::logger::log("\n");
       }
       
+      if (isReproduce == true) jaffarCommon::logger::log("[] Late Frames:    %lu (%.1f fps target)\n", lateFrameCount, 1.0e6 / (double)_INVERSE_FRAME_RATE);
+
       // Only print commands if not in reproduce mode
       if (isReproduce == false) jaffarCommon::logger::log("[] Commands: n: -1 m: +1 | h: -10 | j: +10 | y: -100 | u: +100 | k: -1000 | i: +1000 | s: quicksave | p: play | q: quit\n");
 
@@ -198,6 +242,28 @@ int main(int argc, char *argv[])
     // Resetting show frame info flag
     showFrameInfo = true;
 
+    // In reproduce mode, each step is held until its deadline instead of waiting for a command
+    if (isReproduce == true)
+    {
+      nextFrameTime += std::chrono::microseconds(_INVERSE_FRAME_RATE);
+      const auto currentTime = std::chrono::steady_clock::now();
+
+      // If already late, start counting from now rather than rushing through the next frames
+      if (currentTime > nextFrameTime) { lateFrameCount++; nextFrameTime = currentTime; }
+      else std::this_thread::sleep_until(nextFrameTime);
+
+      // At the end of the sequence, exit if requested, or go back to interactive mode
+      if (currentStep == sequenceLength - 1)
+      {
+        if (exitAfterReproduce == true) continueRunning = false;
+        isReproduce = false;
+        continue;
+      }
+
+      currentStep++;
+      continue;
+    }
+
     // Get command
     auto command = jaffarCommon::logger::waitForKeyPress();
 
@@ -232,12 +298,15 @@ int main(int argc, char *argv[])
     }
 
     // Start playback from current point
-    if (command == 'p') isReproduce = true;
+    if (command == 'p') { isReproduce = true; nextFrameTime = std::chrono::steady_clock::now(); }
 
     // Start playback from current point
     if (command == 'q') continueRunning = false;
   }
 
+  // Stopping background sequence generation before releasing the emulator
+  p.stopBackgroundWorker();
+
   // Finalizing video output
   if (disableRender == false) e.finalizeVideoOutput();
 
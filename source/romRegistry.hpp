@@ -0,0 +1,91 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <jaffarCommon/exceptions.hpp>
+#include <jaffarCommon/file.hpp>
+#include <jaffarCommon/hash.hpp>
+
+namespace jaffar
+{
+
+// Contents of a ROM file, and their SHA1
+struct romImage_t
+{
+  std::string filePath;
+  std::string data;
+  std::string sha1;
+};
+
+// Process-wide registry of ROM images. Each file is read and hashed only once, and files with the same contents share a
+// single image. Images are handed out as shared read-only references and kept until the process ends. Thread-safe
+class RomRegistry
+{
+  public:
+
+  struct statistics_t
+  {
+    size_t lookupCount;
+    size_t fileReadCount;
+    size_t imageCount;
+    size_t imageBytes;
+  };
+
+  static RomRegistry &get()
+  {
+    static RomRegistry registry;
+    return registry;
+  }
+
+  // Gets the image of a ROM file, reading it the first time. If an expected SHA1 is given, it must match
+  std::shared_ptr<const romImage_t> load(const std::string &filePath, const std::string &expectedSHA1 = "")
+  {
+    const auto image = getImage(filePath);
+    if (expectedSHA1 != "" && image->sha1 != expectedSHA1) JAFFAR_THROW_LOGIC("Wrong ROM SHA1. Found: '%s', Expected: '%s'\n", image->sha1.c_str(), expectedSHA1.c_str());
+    return image;
+  }
+
+  statistics_t getStatistics()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t imageBytes = 0;
+    for (const auto &entry : _imagesBySHA1) imageBytes += entry.second->data.size();
+    return {_lookupCount, _fileReadCount, _imagesBySHA1.size(), imageBytes};
+  }
+
+  private:
+
+  RomRegistry() = default;
+
+  std::shared_ptr<const romImage_t> getImage(const std::string &filePath)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lookupCount++;
+
+    const auto entry = _imagesByPath.find(filePath);
+    if (entry != _imagesByPath.end()) return entry->second;
+
+    auto image = std::make_shared<romImage_t>();
+    image->filePath = filePath;
+    if (jaffarCommon::file::loadStringFromFile(image->data, filePath) == false) JAFFAR_THROW_LOGIC("Could not rom file: %s\n", filePath.c_str());
+    image->sha1 = jaffarCommon::hash::getSHA1String(image->data);
+    _fileReadCount++;
+
+    // Another path to the same contents gets the image already registered
+    auto &sharedImage = _imagesBySHA1[image->sha1];
+    if (sharedImage == nullptr) sharedImage = image;
+    _imagesByPath[filePath] = sharedImage;
+    return sharedImage;
+  }
+
+  std::mutex _mutex;
+  std::map<std::string, std::shared_ptr<const romImage_t>> _imagesByPath;
+  std::map<std::string, std::shared_ptr<const romImage_t>> _imagesBySHA1;
+
+  size_t _lookupCount = 0;
+  size_t _fileReadCount = 0;
+};
+
+} // namespace jaffar
@@ -0,0 +1,422 @@
+#pragma once
+
+// Running input sequences through the emulation cycles used to test the core: Simple (advance only) and Rerecord
+// (load / advance / save), either on their own or side by side to find the first step where they diverge
+
+#include <jaffarCommon/json.hpp>
+#include <jaffarCommon/serializers/contiguous.hpp>
+#include <jaffarCommon/serializers/differential.hpp>
+#include <jaffarCommon/deserializers/contiguous.hpp>
+#include <jaffarCommon/deserializers/differential.hpp>
+#include <jaffarCommon/hash.hpp>
+#include <jaffarCommon/file.hpp>
+#include <jaffarCommon/exceptions.hpp>
+#include "a2600HawkInstance.hpp"
+#include "phaseTimer.hpp"
+#include "latencyRing.hpp"
+#include "statePool.hpp"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Emulation actions to perform per input, and how to store the state between them
+struct cycleConfiguration_t
+{
+  bool doPreAdvance;
+  bool doDeserialize;
+  bool doSerialize;
+  size_t stateSize;
+  bool differentialCompressionEnabled;
+  bool differentialCompressionUseZlib;
+  size_t fullDifferentialStateSize;
+
+  // Whether to store each step's state in a new buffer, dropping the previous one, as search engines do
+  bool newStatePerStep;
+};
+
+// Outcome of running an input sequence
+struct runResult_t
+{
+  double elapsedTimeSeconds;
+  size_t differentialStateMaxSizeDetected;
+  size_t systemAllocationCount;
+  jaffarCommon::hash::hash_t finalHash;
+
+  // Lockstep runs only: how the Simple and Rerecord states differed at the first divergent step (empty if they never did)
+  std::string divergenceReport;
+};
+
+// Ways of encoding the state in differential serializers, by the name scripts use for them. The first one is the default
+const std::vector<std::pair<libA2600Hawk::EmuInstance::differentialMode_t, std::string>> differentialEncodings = {
+  {libA2600Hawk::EmuInstance::rawState, "Raw State"},
+  {libA2600Hawk::EmuInstance::genericDiff, "Generic Diff"},
+  {libA2600Hawk::EmuInstance::mutableRegions, "Mutable Regions"}};
+
+// Gets the name of the differential encoding selected by the script's optional 'Differential Compression / Encoding' entry
+inline std::string getDifferentialEncodingName(const nlohmann::json &configJs)
+{
+  const auto &differentialCompressionJs = jaffarCommon::json::getObject(configJs, "Differential Compression");
+  if (differentialCompressionJs.contains("Encoding") == false) return differentialEncodings[0].second;
+  if (differentialCompressionJs["Encoding"].is_string() == false) JAFFAR_THROW_LOGIC("Script file 'Differential Compression / Encoding' entry is not a string\n");
+  return differentialCompressionJs["Encoding"].get<std::string>();
+}
+
+inline libA2600Hawk::EmuInstance::differentialMode_t getDifferentialEncoding(const std::string &name)
+{
+  for (const auto &encoding : differentialEncodings) if (encoding.second == name) return encoding.first;
+  JAFFAR_THROW_LOGIC("Unrecognized differential encoding: '%s'\n", name.c_str());
+}
+
+// Creates an emulator instance ready to run the test script
+inline std::unique_ptr<libA2600Hawk::EmuInstance> createEmuInstance(const nlohmann::json &configJs,
+                                                                    const std::string &romFilePath,
+                                                                    const std::string &initialStateFilePath,
+                                                                    const std::vector<std::string> &stateDisabledBlocks,
+                                                                    const libA2600Hawk::EmuInstance::stateHashMode_t stateHashMode = libA2600Hawk::EmuInstance::metroHash)
+{
+  auto e = std::make_unique<libA2600Hawk::EmuInstance>(configJs);
+  e->setStateHashMode(stateHashMode);
+  e->initialize();
+  e->disableRendering();
+  e->loadROM(romFilePath);
+
+  if (initialStateFilePath != "")
+  {
+    std::string stateFileData;
+    if (jaffarCommon::file::loadStringFromFile(stateFileData, initialStateFilePath) == false) JAFFAR_THROW_LOGIC("Could not initial state file: %s\n", initialStateFilePath.c_str());
+    jaffarCommon::deserializer::Contiguous d(stateFileData.data());
+    e->deserializeState(d);
+  }
+
+  for (const auto &block : stateDisabledBlocks) e->disableStateBlock(block);
+
+  e->setDifferentialMode(getDifferentialEncoding(getDifferentialEncodingName(configJs)));
+
+  return e;
+}
+
+// Performs the emulation cycle on an instance one input at a time, holding the state buffers it needs between steps.
+// If a phase timer is given (and timing is compiled in), each phase of the cycle is timed separately.
+// If a state pool is given, the buffers that store the state between steps (the differential data, if enabled) come from it
+class SequenceCycle
+{
+  public:
+
+  SequenceCycle(libA2600Hawk::EmuInstance &e, const cycleConfiguration_t &config, jaffar::PhaseTimer *timer = nullptr, jaffar::StatePool *statePool = nullptr)
+    : _e(e), _config(config), _timer(timer), _statePool(statePool)
+  {
+    if (_statePool != nullptr && _statePool->getBufferSize() < getStoredStateSize()) JAFFAR_THROW_LOGIC("State pool buffers (%lu bytes) are smaller than the stored state (%lu bytes)\n", _statePool->getBufferSize(), getStoredStateSize());
+
+    if (_config.differentialCompressionEnabled == false) _currentState = allocateStoredState();
+    if (_config.differentialCompressionEnabled == true)
+    {
+      _currentState = (uint8_t *)malloc(_config.stateSize);
+      _systemAllocationCount++;
+      _differentialStateData = allocateStoredState();
+    }
+    reset();
+  }
+
+  ~SequenceCycle()
+  {
+    if (_config.differentialCompressionEnabled == false) freeStoredState(_currentState);
+    if (_config.differentialCompressionEnabled == true)
+    {
+      free(_currentState);
+      freeStoredState(_differentialStateData);
+    }
+  }
+
+  // Takes the instance's current state as the starting point of the cycle
+  void reset()
+  {
+    // Serializing initial state
+    {
+      jaffarCommon::serializer::Contiguous cs(_currentState);
+      _e.serializeState(cs);
+    }
+
+    // Performing the first differential serialization (in case it's used)
+    _differentialStateMaxSizeDetected = 0;
+    if (_config.differentialCompressionEnabled == true)
+    {
+      auto s = jaffarCommon::serializer::Differential(_differentialStateData, _config.fullDifferentialStateSize, _currentState, _config.stateSize, _config.differentialCompressionUseZlib);
+      _e.serializeState(s);
+      _differentialStateMaxSizeDetected = s.getOutputSize();
+    }
+  }
+
+  inline void step(const jaffar::input_t &input)
+  {
+    const auto stateSize = _config.stateSize;
+    const auto fullDifferentialStateSize = _config.fullDifferentialStateSize;
+    const auto differentialCompressionEnabled = _config.differentialCompressionEnabled;
+    const auto differentialCompressionUseZlib = _config.differentialCompressionUseZlib;
+
+    if (_config.doPreAdvance == true) _PHASE_TIMED(_timer, jaffar::PhaseTimer::advance, _e.advanceState(input));
+    
+    if (_config.doDeserialize == true)
+    {
+      if (differentialCompressionEnabled == true) 
+      {
+       _PHASE_TIMED(_timer, jaffar::PhaseTimer::deserialize,
+         jaffarCommon::deserializer::Differential d(_differentialStateData, fullDifferentialStateSize, _currentState, stateSize, differentialCompressionUseZlib);
+         _e.deserializeState(d));
+      }
+
+      if (differentialCompressionEnabled == false)
+      {
+        _PHASE_TIMED(_timer, jaffar::PhaseTimer::deserialize,
+          jaffarCommon::deserializer::Contiguous d(_currentState, stateSize);
+          _e.deserializeState(d));
+      } 
+    } 
+    
+    _PHASE_TIMED(_timer, jaffar::PhaseTimer::advance, _e.advanceState(input));
+
+    if (_config.doSerialize == true)
+    {
+      if (_config.newStatePerStep == true) renewStoredState();
+
+      if (differentialCompressionEnabled == true)
+      {
+        _PHASE_TIMED(_timer, jaffar::PhaseTimer::serialize,
+          auto s = jaffarCommon::serializer::Differential(_differentialStateData, fullDifferentialStateSize, _currentState, stateSize, differentialCompressionUseZlib);
+          _e.serializeState(s);
+          _differentialStateMaxSizeDetected = std::max(_differentialStateMaxSizeDetected, s.getOutputSize()));
+      }  
+
+      if (differentialCompressionEnabled == false) 
+      {
+        _PHASE_TIMED(_timer, jaffar::PhaseTimer::serialize,
+          auto s = jaffarCommon::serializer::Contiguous(_currentState, stateSize);
+          _e.serializeState(s));
+      }
+    } 
+  }
+
+#ifdef _PHASE_TIMING
+  // Timing builds also hash every step, as the search engines do, so that its cost shows in the breakdown.
+  // Returns the time it took, which the caller leaves out of the elapsed time of the sequence
+  inline std::chrono::steady_clock::duration hashStep()
+  {
+    if (_timer == nullptr) return std::chrono::steady_clock::duration::zero();
+    const auto hashStart = jaffar::PhaseTimer::now();
+    volatile auto stepHash = _e.getStateHash().first;
+    (void)stepHash;
+    const auto hashTime = jaffar::PhaseTimer::now() - hashStart;
+    _timer->record(jaffar::PhaseTimer::hash, hashTime);
+    return hashTime;
+  }
+#endif
+
+  inline size_t getDifferentialStateMaxSizeDetected() const { return _differentialStateMaxSizeDetected; }
+
+  // Number of buffers allocated from the system (not counting the ones that came from the pool)
+  inline size_t getSystemAllocationCount() const { return _systemAllocationCount; }
+
+  private:
+
+  inline size_t getStoredStateSize() const { return _config.differentialCompressionEnabled ? _config.fullDifferentialStateSize : _config.stateSize; }
+
+  inline uint8_t *allocateStoredState()
+  {
+    if (_statePool != nullptr) return _statePool->acquire();
+    _systemAllocationCount++;
+    return (uint8_t *)malloc(getStoredStateSize());
+  }
+
+  inline void freeStoredState(uint8_t *state)
+  {
+    if (_statePool != nullptr) _statePool->release(state);
+    if (_statePool == nullptr) free(state);
+  }
+
+  // Replaces the buffer that stores the state between steps with a new one. Its contents are about to be overwritten
+  inline void renewStoredState()
+  {
+    auto &storedState = _config.differentialCompressionEnabled ? _differentialStateData : _currentState;
+    const auto newState = allocateStoredState();
+    freeStoredState(storedState);
+    storedState = newState;
+  }
+
+  libA2600Hawk::EmuInstance &_e;
+  const cycleConfiguration_t _config;
+  jaffar::PhaseTimer *const _timer;
+  jaffar::StatePool *const _statePool;
+
+  uint8_t *_currentState = nullptr;
+  uint8_t *_differentialStateData = nullptr;
+  size_t _differentialStateMaxSizeDetected = 0;
+  size_t _systemAllocationCount = 0;
+};
+
+// Runs the input sequence from the instance's current state with the given cycle configuration.
+// If a phase timer is given (and timing is compiled in), each phase of the cycle is timed separately.
+// If a latency ring is given, the time taken by each step is recorded into it.
+// If a state pool is given, the state stored between steps is kept in its buffers
+inline runResult_t runSequence(libA2600Hawk::EmuInstance &e,
+                               const std::vector<jaffar::input_t> &decodedSequence,
+                               const cycleConfiguration_t &config,
+                               jaffar::PhaseTimer *timer = nullptr,
+                               jaffar::LatencyRing *latencyRing = nullptr,
+                               jaffar::StatePool *statePool = nullptr)
+{
+  runResult_t result;
+
+  SequenceCycle cycle(e, config, timer, statePool);
+
+  // Actually running the sequence
+  auto hashTime = std::chrono::steady_clock::duration::zero();
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (size_t stepId = 0; stepId < decodedSequence.size(); stepId++)
+  {
+    const auto stepStart = latencyRing != nullptr ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+    cycle.step(decodedSequence[stepId]);
+
+    if (latencyRing != nullptr) latencyRing->record(stepId, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - stepStart).count());
+
+#ifdef _PHASE_TIMING
+    hashTime += cycle.hashStep();
+#endif
+  }
+  auto tf = std::chrono::high_resolution_clock::now();
+
+  // Calculating running time, without the per-step hashes of timing builds
+  auto dt = std::chrono::duration_cast<std::chrono::nanoseconds>(tf - t0 - hashTime).count();
+  result.elapsedTimeSeconds = (double)dt * 1.0e-9;
+  result.differentialStateMaxSizeDetected = cycle.getDifferentialStateMaxSizeDetected();
+  result.systemAllocationCount = cycle.getSystemAllocationCount();
+
+  // Calculating final state hash
+  result.finalHash = e.getStateHash();
+
+  return result;
+}
+
+// Appends a formatted line to a report
+template <typename... Args>
+inline void appendReportLine(std::string &report, const char *format, Args... args)
+{
+  char line[512];
+  snprintf(line, sizeof(line), format, args...);
+  report += line;
+}
+
+// Describes the first step where the Simple and Rerecord instances diverged: its input, both state hashes and the work RAM bytes that differ
+inline std::string getDivergenceReport(const libA2600Hawk::EmuInstance &simple,
+                                       const libA2600Hawk::EmuInstance &rerecord,
+                                       const jaffar::input_t &input,
+                                       const size_t divergentStepId,
+                                       const size_t checkpointStepId)
+{
+  const auto simpleHash = simple.getStateHash();
+  const auto rerecordHash = rerecord.getStateHash();
+  uint8_t simpleRam[_WORK_RAM_SIZE];
+  uint8_t rerecordRam[_WORK_RAM_SIZE];
+  simple.getWorkRam(simpleRam);
+  rerecord.getWorkRam(rerecordRam);
+
+  std::string report;
+  appendReportLine(report, "[] Simple and Rerecord cycles diverged at step %lu (states matched after %lu steps)\n", divergentStepId, checkpointStepId);
+  appendReportLine(report, "[]   Input:                                %s\n", simple.getInputParser()->getInputString(input).c_str());
+  appendReportLine(report, "[]   Simple State Hash:                    0x%lX%lX\n", simpleHash.first, simpleHash.second);
+  appendReportLine(report, "[]   Rerecord State Hash:                  0x%lX%lX\n", rerecordHash.first, rerecordHash.second);
+  appendReportLine(report, "[]   Work RAM Differences (Address: Simple / Rerecord):\n");
+  for (size_t i = 0; i < _WORK_RAM_SIZE; i++)
+    if (simpleRam[i] != rerecordRam[i]) appendReportLine(report, "[]     $%02lX: %02X / %02X\n", 0x80 + i, simpleRam[i], rerecordRam[i]);
+  return report;
+}
+
+// Runs the Simple and Rerecord cycles side by side on two instances, comparing their state hashes every given number of steps.
+// On a mismatch, both are taken back to the last matching step and replayed one step at a time to find the first divergent
+// one. The run stops there, and the result carries a report of the divergence for the caller to print.
+// If a state pool is given, both cycles keep their stored states in its buffers
+inline runResult_t runLockstep(libA2600Hawk::EmuInstance &simple,
+                               libA2600Hawk::EmuInstance &rerecord,
+                               const std::vector<jaffar::input_t> &decodedSequence,
+                               const cycleConfiguration_t &simpleConfig,
+                               const cycleConfiguration_t &rerecordConfig,
+                               const size_t interval,
+                               jaffar::PhaseTimer *timer = nullptr,
+                               jaffar::StatePool *statePool = nullptr)
+{
+  runResult_t result;
+
+  SequenceCycle simpleCycle(simple, simpleConfig, timer, statePool);
+  SequenceCycle rerecordCycle(rerecord, rerecordConfig, timer, statePool);
+
+  // Both instances must start from the same state
+  if (simple.getStateHash() != rerecord.getStateHash()) JAFFAR_THROW_RUNTIME("Simple and Rerecord instances differ before the first step\n");
+
+  // Number of steps after which the states last matched (and the state of both instances then), needed only to narrow down a mismatch when not comparing every step
+  size_t checkpointStepId = 0;
+  std::vector<uint8_t> simpleCheckpoint;
+  std::vector<uint8_t> rerecordCheckpoint;
+  auto saveCheckpoint = [&](const size_t stepId) {
+    checkpointStepId = stepId;
+    if (interval == 1) return;
+    simpleCheckpoint.resize(simple.getStateSize());
+    rerecordCheckpoint.resize(rerecord.getStateSize());
+    jaffarCommon::serializer::Contiguous ss(simpleCheckpoint.data(), simpleCheckpoint.size());
+    simple.serializeState(ss);
+    jaffarCommon::serializer::Contiguous rs(rerecordCheckpoint.data(), rerecordCheckpoint.size());
+    rerecord.serializeState(rs);
+  };
+  saveCheckpoint(0);
+
+  auto hashTime = std::chrono::steady_clock::duration::zero();
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (size_t stepId = 0; stepId < decodedSequence.size(); stepId++)
+  {
+    simpleCycle.step(decodedSequence[stepId]);
+    rerecordCycle.step(decodedSequence[stepId]);
+
+#ifdef _PHASE_TIMING
+    hashTime += simpleCycle.hashStep();
+    hashTime += rerecordCycle.hashStep();
+#endif
+
+    // Comparing every interval steps, and always after the last one
+    const size_t stepCount = stepId + 1;
+    if (stepCount % interval != 0 && stepCount != decodedSequence.size()) continue;
+    if (simple.getStateHash() == rerecord.getStateHash()) { saveCheckpoint(stepCount); continue; }
+
+    // Replaying from the last matching step, one step at a time, to find the first divergent one
+    size_t divergentStepId = stepId;
+    if (interval > 1)
+    {
+      jaffarCommon::deserializer::Contiguous sd(simpleCheckpoint.data(), simpleCheckpoint.size());
+      simple.deserializeState(sd);
+      jaffarCommon::deserializer::Contiguous rd(rerecordCheckpoint.data(), rerecordCheckpoint.size());
+      rerecord.deserializeState(rd);
+      simpleCycle.reset();
+      rerecordCycle.reset();
+
+      bool reproduced = false;
+      for (divergentStepId = checkpointStepId; divergentStepId <= stepId && reproduced == false; divergentStepId++)
+      {
+        simpleCycle.step(decodedSequence[divergentStepId]);
+        rerecordCycle.step(decodedSequence[divergentStepId]);
+        reproduced = simple.getStateHash() != rerecord.getStateHash();
+      }
+      divergentStepId--;
+
+      if (reproduced == false) JAFFAR_THROW_RUNTIME("Simple and Rerecord cycles diverged between steps %lu and %lu, but not when replaying them\n", checkpointStepId, stepId);
+    }
+
+    result.divergenceReport = getDivergenceReport(simple, rerecord, decodedSequence[divergentStepId], divergentStepId, checkpointStepId);
+    break;
+  }
+  auto tf = std::chrono::high_resolution_clock::now();
+
+  result.elapsedTimeSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tf - t0 - hashTime).count() * 1.0e-9;
+  result.differentialStateMaxSizeDetected = rerecordCycle.getDifferentialStateMaxSizeDetected();
+  result.systemAllocationCount = simpleCycle.getSystemAllocationCount() + rerecordCycle.getSystemAllocationCount();
+  result.finalHash = simple.getStateHash();
+
+  return result;
+}
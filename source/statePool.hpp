@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#ifdef __linux__
+  #include <sys/mman.h>
+#endif
+#include <jaffarCommon/exceptions.hpp>
+
+// Alignment of every buffer in the pool, so that no two buffers share a cache line
+#define _STATE_POOL_ALIGNMENT 64
+
+// Size and alignment of a transparent huge page
+#define _STATE_POOL_HUGE_PAGE_SIZE 2097152
+
+namespace jaffar
+{
+
+// Pool of fixed-size state buffers, carved out of large chunks that are only returned to the system when the pool is destroyed.
+// Released buffers are reused first, so a steady acquire / release pattern stops allocating once the pool has grown enough.
+// The pool is not thread-safe: each thread is meant to have its own. With prefaulting, every page of a chunk is touched when
+// the chunk is allocated, so page faults are paid then instead of on the first use of each buffer
+class StatePool
+{
+  public:
+
+  struct statistics_t
+  {
+    size_t acquireCount;
+    size_t reuseCount;
+    size_t systemAllocationCount;
+    size_t buffersInUse;
+    size_t reservedBytes;
+  };
+
+  StatePool(const size_t bufferSize, const size_t buffersPerChunk = 64, const bool useHugePages = false, const bool prefault = false)
+    : _bufferSize(bufferSize)
+    , _bufferStride((bufferSize + _STATE_POOL_ALIGNMENT - 1) / _STATE_POOL_ALIGNMENT * _STATE_POOL_ALIGNMENT)
+    , _useHugePages(useHugePages)
+    , _prefault(prefault)
+  {
+    if (_bufferSize == 0) JAFFAR_THROW_LOGIC("The state pool buffer size must be at least 1\n");
+    if (buffersPerChunk == 0) JAFFAR_THROW_LOGIC("The state pool needs at least one buffer per chunk\n");
+
+    // Huge page chunks are rounded up to whole huge pages, fitting as many buffers as possible
+    _chunkBytes = _bufferStride * buffersPerChunk;
+    if (_useHugePages == true) _chunkBytes = (_chunkBytes + _STATE_POOL_HUGE_PAGE_SIZE - 1) / _STATE_POOL_HUGE_PAGE_SIZE * _STATE_POOL_HUGE_PAGE_SIZE;
+    _buffersPerChunk = _chunkBytes / _bufferStride;
+
+    // The first acquire allocates the first chunk
+    _nextBufferInChunk = _buffersPerChunk;
+  }
+
+  ~StatePool()
+  {
+    for (const auto chunk : _chunks) free(chunk);
+  }
+
+  StatePool(const StatePool &) = delete;
+  StatePool &operator=(const StatePool &) = delete;
+
+  inline uint8_t *acquire()
+  {
+    _acquireCount++;
+    _buffersInUse++;
+
+    if (_freeBuffers.empty() == false)
+    {
+      _reuseCount++;
+      const auto buffer = _freeBuffers.back();
+      _freeBuffers.pop_back();
+      return buffer;
+    }
+
+    if (_nextBufferInChunk == _buffersPerChunk) allocateChunk();
+    return _chunks.back() + _bufferStride * _nextBufferInChunk++;
+  }
+
+  inline void release(uint8_t *buffer)
+  {
+    _buffersInUse--;
+    _freeBuffers.push_back(buffer);
+  }
+
+  inline size_t getBufferSize() const { return _bufferSize; }
+
+  statistics_t getStatistics() const { return {_acquireCount, _reuseCount, _chunks.size(), _buffersInUse, _chunks.size() * _chunkBytes}; }
+
+  private:
+
+  void allocateChunk()
+  {
+    const size_t alignment = _useHugePages ? _STATE_POOL_HUGE_PAGE_SIZE : _STATE_POOL_ALIGNMENT;
+    auto chunk = (uint8_t *)aligned_alloc(alignment, _chunkBytes);
+    if (chunk == nullptr) JAFFAR_THROW_RUNTIME("Could not allocate a state pool chunk of %lu bytes\n", _chunkBytes);
+
+#ifdef __linux__
+    if (_useHugePages == true) madvise(chunk, _chunkBytes, MADV_HUGEPAGE);
+#endif
+
+    // Faulting in every page now
+    if (_prefault == true) memset(chunk, 0, _chunkBytes);
+
+    _chunks.push_back(chunk);
+    _freeBuffers.reserve(_chunks.size() * _buffersPerChunk);
+    _nextBufferInChunk = 0;
+  }
+
+  const size_t _bufferSize;
+  const size_t _bufferStride;
+  const bool _useHugePages;
+  const bool _prefault;
+  size_t _chunkBytes;
+  size_t _buffersPerChunk;
+
+  std::vector<uint8_t *> _chunks;
+  std::vector<uint8_t *> _freeBuffers;
+  size_t _nextBufferInChunk;
+
+  size_t _acquireCount = 0;
+  size_t _reuseCount = 0;
+  size_t _buffersInUse = 0;
+};
+
+// Resident set size of the process, in bytes (0 if not available)
+inline size_t getResidentSetSize()
+{
+  auto statm = fopen("/proc/self/statm", "r");
+  if (statm == nullptr) return 0;
+
+  size_t totalPages = 0;
+  size_t residentPages = 0;
+  const auto fields = fscanf(statm, "%lu %lu", &totalPages, &residentPages);
+  fclose(statm);
+
+  if (fields != 2) return 0;
+  return residentPages * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+} // namespace jaffar
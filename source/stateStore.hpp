@@ -0,0 +1,190 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <jaffarCommon/exceptions.hpp>
+#include "statePool.hpp"
+#include "xorDelta.hpp"
+
+// Compact storage for a sequence of save states. A full copy (keyframe) is stored every
+// few steps, and the steps in between are stored as run-length encoded XOR deltas against
+// the previous step. Recently decoded states are kept in a small LRU cache. Every full-size
+// state buffer (keyframes, cached states and scratch buffers) comes from the given pool.
+class StateStore
+{
+  public:
+
+  struct statistics_t
+  {
+    size_t residentBytes;
+    size_t uncompressedBytes;
+    size_t lastDecodeTime;
+    double averageDecodeTime;
+  };
+
+  StateStore(jaffar::StatePool &statePool, const size_t keyframeInterval, const size_t cacheCapacity)
+    : _statePool(statePool)
+    , _stateSize(statePool.getBufferSize())
+    , _keyframeInterval(keyframeInterval)
+    , _cacheCapacity(cacheCapacity)
+  {
+    if (_keyframeInterval == 0) JAFFAR_THROW_LOGIC("The keyframe interval must be at least 1\n");
+    if (_cacheCapacity == 0) JAFFAR_THROW_LOGIC("The state cache capacity must be at least 1\n");
+
+    _previousState = _statePool.acquire();
+    _decodeBuffer = _statePool.acquire();
+  }
+
+  ~StateStore()
+  {
+    _statePool.release(_previousState);
+    _statePool.release(_decodeBuffer);
+    for (const auto keyframe : _keyframes) _statePool.release(keyframe);
+    for (const auto &entry : _cache) _statePool.release(entry.second.state);
+  }
+
+  StateStore(const StateStore &) = delete;
+  StateStore &operator=(const StateStore &) = delete;
+
+  // Appends the next state of the sequence
+  void push(const uint8_t *state)
+  {
+    const size_t stepId = _steps.size();
+
+    // Keyframes are kept apart, leaving their delta empty
+    std::vector<uint8_t> data;
+    if (stepId % _keyframeInterval == 0)
+    {
+      auto keyframe = _statePool.acquire();
+      memcpy(keyframe, state, _stateSize);
+      _keyframes.push_back(keyframe);
+      _storedBytes += _stateSize;
+    }
+    if (stepId % _keyframeInterval != 0) jaffar::xorDelta::encode(_previousState, state, _stateSize, data);
+    data.shrink_to_fit();
+
+    _storedBytes += data.size();
+    _steps.push_back(std::move(data));
+    memcpy(_previousState, state, _stateSize);
+  }
+
+  // Returns the decoded state for the given step. The pointer remains valid until the next call to get()
+  const uint8_t *get(const size_t stepId)
+  {
+    if (stepId >= _steps.size()) JAFFAR_THROW_RUNTIME("[Error] Attempting to get state for step %lu, but only %lu are stored\n", stepId, _steps.size());
+
+    // If cached, mark it as most recently used and return it
+    auto cacheEntry = _cache.find(stepId);
+    if (cacheEntry != _cache.end())
+    {
+      _lruList.splice(_lruList.begin(), _lruList, cacheEntry->second.lruPosition);
+      return cacheEntry->second.state;
+    }
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+
+    // Starting from the closest cached state after the keyframe, or from the keyframe itself
+    const size_t keyframeId = stepId - stepId % _keyframeInterval;
+    size_t baseId = keyframeId;
+    const uint8_t *baseState = _keyframes[keyframeId / _keyframeInterval];
+    for (size_t i = stepId; i > keyframeId + 1; i--)
+    {
+      auto entry = _cache.find(i - 1);
+      if (entry != _cache.end())
+      {
+        baseId = i - 1;
+        baseState = entry->second.state;
+        break;
+      }
+    }
+
+    // Applying deltas up to the requested step
+    memcpy(_decodeBuffer, baseState, _stateSize);
+    for (size_t i = baseId + 1; i <= stepId; i++) jaffar::xorDelta::apply(_steps[i].data(), _steps[i].size(), _decodeBuffer);
+
+    // Storing the decoded state in the cache, reusing the buffer of the least recently used one if full
+    uint8_t *state = nullptr;
+    if (_cache.size() >= _cacheCapacity)
+    {
+      const auto evictedId = _lruList.back();
+      state = _cache[evictedId].state;
+      _cache.erase(evictedId);
+      _lruList.pop_back();
+    }
+    if (state == nullptr) state = _statePool.acquire();
+    memcpy(state, _decodeBuffer, _stateSize);
+    _lruList.push_front(stepId);
+    auto &newEntry = _cache[stepId];
+    newEntry.state = state;
+    newEntry.lruPosition = _lruList.begin();
+
+    auto tf = std::chrono::high_resolution_clock::now();
+    _lastDecodeTime = std::chrono::duration_cast<std::chrono::nanoseconds>(tf - t0).count();
+    _totalDecodeTime += _lastDecodeTime;
+    _decodeCount++;
+
+    return newEntry.state;
+  }
+
+  size_t size() const { return _steps.size(); }
+
+  // Bytes used by the stored keyframes and deltas
+  size_t getStoredBytes() const { return _storedBytes; }
+
+  // Bytes used by the stored keyframes and deltas, plus the decoded state cache
+  size_t getResidentBytes() const { return _storedBytes + _cache.size() * _stateSize; }
+
+  // Bytes that storing a full copy of every state would take
+  size_t getUncompressedBytes() const { return _steps.size() * _stateSize; }
+
+  size_t getLastDecodeTime() const { return _lastDecodeTime; }
+  double getAverageDecodeTime() const { return _decodeCount == 0 ? 0.0 : (double)_totalDecodeTime / (double)_decodeCount; }
+
+  statistics_t getStatistics() const { return {getResidentBytes(), getUncompressedBytes(), getLastDecodeTime(), getAverageDecodeTime()}; }
+
+  private:
+
+  struct cacheEntry_t
+  {
+    uint8_t *state;
+    std::list<size_t>::iterator lruPosition;
+  };
+
+  // Pool for the full-size state buffers
+  jaffar::StatePool &_statePool;
+
+  // Size of each state
+  const size_t _stateSize;
+
+  // Number of steps between keyframes
+  const size_t _keyframeInterval;
+
+  // Maximum number of decoded states to keep
+  const size_t _cacheCapacity;
+
+  // Delta data per step (empty for keyframes)
+  std::vector<std::vector<uint8_t>> _steps;
+
+  // Keyframe states, one every keyframe interval steps
+  std::vector<uint8_t *> _keyframes;
+
+  // Last pushed state, used to encode the next delta
+  uint8_t *_previousState;
+
+  // Scratch buffer for decoding
+  uint8_t *_decodeBuffer;
+
+  // Decoded state cache, most recently used step first
+  std::unordered_map<size_t, cacheEntry_t> _cache;
+  std::list<size_t> _lruList;
+
+  // Statistics
+  size_t _storedBytes = 0;
+  size_t _lastDecodeTime = 0;
+  size_t _totalDecodeTime = 0;
+  size_t _decodeCount = 0;
+};
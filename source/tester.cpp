@@ -10,11 +10,833 @@
 #include <jaffarCommon/logger.hpp>
 #include <jaffarCommon/file.hpp>
 #include "a2600HawkInstance.hpp"
+#include "movieFile.hpp"
+#include "frameWriter.hpp"
+#include "phaseTimer.hpp"
+#include "latencyRing.hpp"
+#include "sequenceRunner.hpp"
+#include "romRegistry.hpp"
+#include "batchEngine.hpp"
 #include <chrono>
+#include <memory>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
 #include <string>
 
+// Maximum number of steps kept for the latency analysis
+#define _LATENCY_RING_CAPACITY 1048576
+
+// Number of live instances created by the startup benchmark and by each method in the clone benchmark, and of clone / destroy cycles measured afterwards
+#define _CLONE_BENCHMARK_INSTANCES 64
+#define _CLONE_BENCHMARK_CYCLES 4096
+
+// Number of state size queries (and state block toggles) timed by the state size benchmark
+#define _STATE_SIZE_BENCHMARK_QUERIES 1024
+
+// Number of lanes advanced for each batch size in the batch engine benchmark
+#define _BATCH_BENCHMARK_LANES 16384
+
+// Runs the sequence concurrently on the first threadCount instances, one thread per instance, starting all of them from the given state
+double runParallel(std::vector<std::unique_ptr<libA2600Hawk::EmuInstance>> &instances,
+                   const size_t threadCount,
+                   const std::vector<uint8_t> &initialState,
+                   const std::vector<jaffar::input_t> &decodedSequence,
+                   const cycleConfiguration_t &config,
+                   std::vector<runResult_t> &results)
+{
+  results.resize(threadCount);
+
+  // Threads block (rather than spin) until all are ready and the start is given, so waiting ones do not take CPU time from the others
+  std::mutex startMutex;
+  std::condition_variable readyCondition;
+  std::condition_variable startCondition;
+  size_t readyThreads = 0;
+  bool startRunning = false;
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < threadCount; i++)
+    threads.emplace_back([&, i]() {
+      jaffarCommon::deserializer::Contiguous d(initialState.data(), initialState.size());
+      instances[i]->deserializeState(d);
+
+      // Waiting for all threads to be ready, so they all run at the same time
+      {
+        std::unique_lock<std::mutex> lock(startMutex);
+        readyThreads++;
+        readyCondition.notify_one();
+        startCondition.wait(lock, [&]() { return startRunning == true; });
+      }
+
+      results[i] = runSequence(*instances[i], decodedSequence, config);
+    });
+
+  std::unique_lock<std::mutex> lock(startMutex);
+  readyCondition.wait(lock, [&]() { return readyThreads == threadCount; });
+  auto t0 = std::chrono::high_resolution_clock::now();
+  startRunning = true;
+  lock.unlock();
+  startCondition.notify_all();
+  for (auto &thread : threads) thread.join();
+  auto tf = std::chrono::high_resolution_clock::now();
+
+  return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tf - t0).count() * 1.0e-9;
+}
+
+// What the benchmarks need from the test run: how to create instances like the tested one, the sequence and cycle it ran,
+// and the final state it reached, which every other run of the sequence must reach as well
+struct testRun_t
+{
+  nlohmann::json configJs;
+  std::string romFilePath;
+  std::string initialStateFilePath;
+  std::vector<std::string> stateDisabledBlocks;
+  libA2600Hawk::EmuInstance::stateHashMode_t stateHashMode;
+  std::string cycleType;
+  std::vector<jaffar::input_t> decodedSequence;
+  cycleConfiguration_t cycleConfiguration;
+  size_t differentialCompressionMaxDifferences;
+  jaffarCommon::hash::hash_t finalHash;
+};
+
+// Formats a state hash as the tester prints it
+std::string getHashString(const jaffarCommon::hash::hash_t &hash)
+{
+  char hashStringBuffer[256];
+  sprintf(hashStringBuffer, "0x%lX%lX", hash.first, hash.second);
+  return std::string(hashStringBuffer);
+}
+
+// Gets the Rerecord cycle (load / advance / save), storing the state as the given configuration does
+cycleConfiguration_t getRerecordConfiguration(const cycleConfiguration_t &config)
+{
+  auto rerecordConfiguration = config;
+  rerecordConfiguration.doPreAdvance = true;
+  rerecordConfiguration.doDeserialize = true;
+  rerecordConfiguration.doSerialize = true;
+  return rerecordConfiguration;
+}
+
+// Creates an instance set up like the tested one
+std::unique_ptr<libA2600Hawk::EmuInstance> createTestInstance(const testRun_t &test)
+{
+  return createEmuInstance(test.configJs, test.romFilePath, test.initialStateFilePath, test.stateDisabledBlocks, test.stateHashMode);
+}
+
+// Runs the test sequence on the instance with the given cycle configuration, and checks that it reaches the final state of the test run
+runResult_t runAndCheck(const testRun_t &test, libA2600Hawk::EmuInstance &instance, const cycleConfiguration_t &config, const std::string &runName, jaffar::StatePool *statePool = nullptr)
+{
+  const auto runResult = runSequence(instance, test.decodedSequence, config, nullptr, nullptr, statePool);
+  if (runResult.finalHash != test.finalHash) JAFFAR_THROW_RUNTIME("Final state hash of the '%s' run (%s) differs from the test run (%s)\n", runName.c_str(), getHashString(runResult.finalHash).c_str(), getHashString(test.finalHash).c_str());
+  return runResult;
+}
+
+// Measures the hashing throughput of the per-byte and bulk RAM read paths on the tested instance, and the per-step cost of each state hash
+void runHashBenchmark(const testRun_t &test, libA2600Hawk::EmuInstance &e)
+{
+  const auto &decodedSequence = test.decodedSequence;
+  const auto sequenceLength = decodedSequence.size();
+
+  const size_t hashIterations = 100000;
+  jaffarCommon::hash::hash_t perByteHash;
+  jaffarCommon::hash::hash_t bulkHash;
+
+  // Both paths read the RAM with one core call per byte, as the core exports no bulk read. They only differ in the
+  // virtual call per byte and in how the bytes are fed to the hash
+
+  // Per-byte path: one virtual call and one hash update per RAM byte
+  auto th0 = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < hashIterations; i++)
+  {
+    MetroHash128 hash;
+    for (size_t j = 0; j < _WORK_RAM_SIZE; j++) hash.Update(e.getWorkRamByte(j));
+    hash.Finalize(reinterpret_cast<uint8_t *>(&perByteHash));
+  }
+  auto th1 = std::chrono::high_resolution_clock::now();
+
+  // Copy path: the RAM is copied into a buffer, which is hashed with a single update
+  e.setStateHashMode(libA2600Hawk::EmuInstance::metroHash);
+  for (size_t i = 0; i < hashIterations; i++) bulkHash = e.getStateHash();
+  auto th2 = std::chrono::high_resolution_clock::now();
+  e.setStateHashMode(test.stateHashMode);
+
+  if (perByteHash != bulkHash) JAFFAR_THROW_RUNTIME("Per-byte and RAM copy state hashes differ\n");
+
+  double perByteSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(th1 - th0).count() * 1.0e-9;
+  double bulkSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(th2 - th1).count() * 1.0e-9;
+  printf("[] Hash Performance (Per-Byte Updates):    %.3f hashes / s\n", (double)hashIterations / perByteSeconds);
+  printf("[] Hash Performance (RAM Copy, 1 Update):  %.3f hashes / s\n", (double)hashIterations / bulkSeconds);
+  printf("[] Core Calls Per Hash:                    %d in both (one per RAM byte, the core exports no bulk read)\n", _WORK_RAM_SIZE);
+
+  // Cost of hashing after every step of the sequence with each state hash, which depends on how much of the RAM each step changes.
+  // Every hash first reads the whole work RAM from the core, so that read is timed on its own and shown separately
+  const std::vector<std::pair<libA2600Hawk::EmuInstance::stateHashMode_t, std::string>> stateHashModes = {
+    {libA2600Hawk::EmuInstance::metroHash, "MetroHash"},
+    {libA2600Hawk::EmuInstance::zobristHash, "Zobrist"},
+    {libA2600Hawk::EmuInstance::zobristHashChecked, "Zobrist Checked"}};
+
+  size_t changedBytes = 0;
+  std::chrono::nanoseconds::rep ramReadTime = 0;
+  std::vector<std::chrono::nanoseconds::rep> hashTimes;
+  for (const auto &hashMode : stateHashModes)
+  {
+    auto hashInstance = createEmuInstance(test.configJs, test.romFilePath, test.initialStateFilePath, test.stateDisabledBlocks, hashMode.first);
+    uint8_t previousRam[_WORK_RAM_SIZE];
+    uint8_t currentRam[_WORK_RAM_SIZE];
+    hashInstance->getWorkRam(previousRam);
+    hashInstance->getStateHash();
+
+    std::chrono::nanoseconds::rep hashTime = 0;
+    for (const auto &input : decodedSequence)
+    {
+      hashInstance->advanceState(input);
+      auto ts0 = std::chrono::high_resolution_clock::now();
+      volatile auto stepHash = hashInstance->getStateHash().first;
+      (void)stepHash;
+      auto ts1 = std::chrono::high_resolution_clock::now();
+      hashTime += std::chrono::duration_cast<std::chrono::nanoseconds>(ts1 - ts0).count();
+
+      if (hashMode.first != libA2600Hawk::EmuInstance::metroHash) continue;
+      auto ts2 = std::chrono::high_resolution_clock::now();
+      hashInstance->getWorkRam(currentRam);
+      auto ts3 = std::chrono::high_resolution_clock::now();
+      ramReadTime += std::chrono::duration_cast<std::chrono::nanoseconds>(ts3 - ts2).count();
+      for (size_t i = 0; i < _WORK_RAM_SIZE; i++) changedBytes += previousRam[i] != currentRam[i];
+      memcpy(previousRam, currentRam, _WORK_RAM_SIZE);
+    }
+
+    hashTimes.push_back(hashTime);
+  }
+
+  const double ramReadCost = (double)ramReadTime / (double)sequenceLength;
+  printf("[] Work RAM Read Per Step (Shared):        %.3f ns (%d core calls, included in every hash cost below)\n", ramReadCost, _WORK_RAM_SIZE);
+  for (size_t i = 0; i < stateHashModes.size(); i++)
+  {
+    const double hashCost = (double)hashTimes[i] / (double)sequenceLength;
+  printf("[] Hash Cost Per Step (%-19s %.3f ns (%.3f ns beyond the RAM read)\n", (stateHashModes[i].second + std::string("):")).c_str(), hashCost, hashCost - ramReadCost);
+  }
+  printf("[] Work RAM Bytes Changed Per Step:        %.3f / %d\n", (double)changedBytes / (double)sequenceLength, _WORK_RAM_SIZE);
+  printf("[] Incremental Zobrist Hash Check:         Passed (%lu steps)\n", sequenceLength);
+}
+
+// Reports the tested instance's transition cache usage, and the cost of a hit compared to emulating a frame
+void reportTransitionCache(const testRun_t &test, libA2600Hawk::EmuInstance &e, const size_t transitionCacheBytes)
+{
+  const auto &decodedSequence = test.decodedSequence;
+  const auto sequenceLength = decodedSequence.size();
+  const auto stateSize = test.cycleConfiguration.stateSize;
+
+  const auto transitionCache = e.getTransitionCache();
+  printf("[] Transition Cache Entries:               %lu / %lu\n", transitionCache->getEntryCount(), transitionCache->getCapacity());
+  printf("[] Transition Cache Hit Rate:              %.3f%% (%lu / %lu)\n", 100.0 * transitionCache->getHitRate(), transitionCache->getHitCount(), transitionCache->getLookupCount());
+  printf("[] Transition Cache Evictions:             %lu\n", transitionCache->getEvictionCount());
+  printf("[] Transition Cache Memory:                %lu / %lu bytes (%lu per entry, state included)\n", transitionCache->getUsedBytes(), transitionCacheBytes, transitionCache->getEntryBytes());
+  printf("[] Transition Cache Note:                  Keys hash the whole Hawk state, frame counters included, so hits only\n");
+  printf("[]                                         come from re-advancing a just-seen state (Rerecord cycles). Search\n");
+  printf("[]                                         workloads rarely revisit an exact state and would see a lower hit rate\n");
+
+  // Measuring the work done on a hit (serialize, hash and restore) against a plain frame advance, from the final state
+  e.disableTransitionCache();
+  const size_t costIterations = 1000;
+  std::vector<uint8_t> finalState(stateSize);
+  std::vector<uint8_t> tempState(stateSize);
+  {
+    jaffarCommon::serializer::Contiguous s(finalState.data(), stateSize);
+    e.serializeState(s);
+  }
+
+  auto tc0 = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < costIterations; i++)
+  {
+    jaffarCommon::serializer::Contiguous s(tempState.data(), stateSize);
+    e.serializeState(s);
+    volatile auto key = libA2600Hawk::TransitionCache::getKey(tempState.data(), stateSize, decodedSequence[i % sequenceLength]).first;
+    (void)key;
+    jaffarCommon::deserializer::Contiguous d(finalState.data(), stateSize);
+    e.deserializeState(d);
+  }
+  auto tc1 = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < costIterations; i++)
+  {
+    jaffarCommon::deserializer::Contiguous d(finalState.data(), stateSize);
+    e.deserializeState(d);
+    e.advanceState(decodedSequence[i % sequenceLength]);
+  }
+  auto tc2 = std::chrono::high_resolution_clock::now();
+
+  // Restoring the final state
+  jaffarCommon::deserializer::Contiguous d(finalState.data(), stateSize);
+  e.deserializeState(d);
+
+  const double hitCost = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tc1 - tc0).count() / (double)costIterations;
+  const double advanceCost = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tc2 - tc1).count() / (double)costIterations;
+  printf("[] Transition Cache Hit Cost:              %.3f us (serialize + hash + restore)\n", hitCost * 1.0e-3);
+  printf("[] Frame Advance Cost:                     %.3f us (restore + advance)\n", advanceCost * 1.0e-3);
+}
+
+// Measures the throughput of the reference, fast and batch input parsers
+void runParserBenchmark(const testRun_t &test, const jaffar::InputParser &inputParser)
+{
+  const auto &decodedSequence = test.decodedSequence;
+  const auto sequenceLength = decodedSequence.size();
+
+  // Regenerating the input strings, so this works for binary movies too
+  std::vector<std::string> inputStrings;
+  std::string inputSequence;
+  for (const auto &input : decodedSequence) inputStrings.push_back(inputParser.getInputString(input));
+  for (const auto &inputString : inputStrings) inputSequence += inputString + std::string("\n");
+
+  // Repeating the sequence enough times to get a stable measurement
+  const size_t parserIterations = std::max((size_t)1, (size_t)1000000 / std::max((size_t)1, sequenceLength));
+  std::vector<jaffar::input_t> referenceInputs(sequenceLength);
+  std::vector<jaffar::input_t> fastInputs(sequenceLength);
+  std::vector<jaffar::input_t> batchInputs;
+
+  auto tp0 = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < parserIterations; i++)
+    for (size_t j = 0; j < sequenceLength; j++) referenceInputs[j] = inputParser.parseInputString(inputStrings[j]);
+  auto tp1 = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < parserIterations; i++)
+    for (size_t j = 0; j < sequenceLength; j++) fastInputs[j] = inputParser.parseInputStringFast(inputStrings[j]);
+  auto tp2 = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < parserIterations; i++)
+  {
+    batchInputs.clear();
+    inputParser.parseInputSequence(inputSequence, batchInputs);
+  }
+  auto tp3 = std::chrono::high_resolution_clock::now();
+
+  // All parsers must agree with the reference
+  for (size_t j = 0; j < sequenceLength; j++)
+  {
+    if (fastInputs[j] != referenceInputs[j]) JAFFAR_THROW_RUNTIME("Fast parser result differs from the reference at input %lu\n", j);
+    if (batchInputs[j] != referenceInputs[j]) JAFFAR_THROW_RUNTIME("Batch parser result differs from the reference at input %lu\n", j);
+  }
+
+  const double parsedInputs = (double)(parserIterations * sequenceLength);
+  const double referenceSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tp1 - tp0).count() * 1.0e-9;
+  const double fastSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tp2 - tp1).count() * 1.0e-9;
+  const double batchSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tp3 - tp2).count() * 1.0e-9;
+  printf("[] Parser Performance (Reference):         %.3f inputs / s\n", parsedInputs / referenceSeconds);
+  printf("[] Parser Performance (Fast):              %.3f inputs / s\n", parsedInputs / fastSeconds);
+  printf("[] Parser Performance (Batch):             %.3f inputs / s\n", parsedInputs / batchSeconds);
+}
+
+// Measures asking the core for the state size against the cached size. The Rerecord cycle never queried the size per step,
+// so the saving is where it used to be queried: enabling or disabling a state block, which probed it twice
+void runStateSizeBenchmark(const testRun_t &test, libA2600Hawk::EmuInstance &e)
+{
+  const auto sequenceLength = test.decodedSequence.size();
+
+  // The Rerecord cycle as the test runs it, for reference
+  auto rerecordInstance = createTestInstance(test);
+  const auto rerecordResult = runAndCheck(test, *rerecordInstance, getRerecordConfiguration(test.cycleConfiguration), "Rerecord Reference");
+  const double rerecordStepNs = sequenceLength > 0 ? rerecordResult.elapsedTimeSeconds * 1.0e9 / (double)sequenceLength : 0.0;
+
+  size_t probedStateSize = 0;
+  size_t cachedStateSize = 0;
+  auto tq0 = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < _STATE_SIZE_BENCHMARK_QUERIES; i++) probedStateSize += e.probeStateSize();
+  auto tq1 = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < _STATE_SIZE_BENCHMARK_QUERIES; i++) cachedStateSize += e.getStateSize();
+  auto tq2 = std::chrono::high_resolution_clock::now();
+  if (probedStateSize < cachedStateSize) JAFFAR_THROW_RUNTIME("Probed state size (%lu) is smaller than the cached one (%lu)\n", probedStateSize / _STATE_SIZE_BENCHMARK_QUERIES, cachedStateSize / _STATE_SIZE_BENCHMARK_QUERIES);
+
+  const double probedQueryNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tq1 - tq0).count() / (double)_STATE_SIZE_BENCHMARK_QUERIES;
+  const double cachedQueryNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tq2 - tq1).count() / (double)_STATE_SIZE_BENCHMARK_QUERIES;
+  printf("[] Rerecord Cycle (Reference):             %.3f us / input\n", rerecordStepNs * 1.0e-3);
+  printf("[] State Size Query (Probed Through Core): %.3f us\n", probedQueryNs * 1.0e-3);
+  printf("[] State Size Query (Cached):              %.3f us\n", cachedQueryNs * 1.0e-3);
+
+  // Toggling the first state block, if any, which no longer probes the size twice
+  const auto stateBlockNames = rerecordInstance->getStateBlockNames();
+  if (stateBlockNames.empty() == false)
+  {
+    auto tt0 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < _STATE_SIZE_BENCHMARK_QUERIES; i++)
+    {
+      rerecordInstance->disableStateBlock(stateBlockNames[0]);
+      rerecordInstance->enableStateBlock(stateBlockNames[0]);
+    }
+    auto tt1 = std::chrono::high_resolution_clock::now();
+    const double toggleNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tt1 - tt0).count() / (double)_STATE_SIZE_BENCHMARK_QUERIES;
+  printf("[] State Block Toggle (Cached Size):       %.3f us ('%s' disabled and enabled)\n", toggleNs * 1.0e-3, stateBlockNames[0].c_str());
+  printf("[] State Block Toggle (Probing Size):      %.3f us (estimated, four probes added)\n", (toggleNs + 4.0 * probedQueryNs) * 1.0e-3);
+  }
+}
+
+// Compares allocating a new buffer for each step's state with malloc against taking it from the state pool
+void runStatePoolBenchmark(const testRun_t &test)
+{
+  const auto sequenceLength = test.decodedSequence.size();
+
+  auto poolCycleConfiguration = getRerecordConfiguration(test.cycleConfiguration);
+  poolCycleConfiguration.newStatePerStep = true;
+  const size_t storedStateSize = poolCycleConfiguration.differentialCompressionEnabled ? poolCycleConfiguration.fullDifferentialStateSize : poolCycleConfiguration.stateSize;
+
+  const char *allocatorNames[4] = {"Malloc", "Pool", "Pool + Huge Pages", "Pool + Prefaulted"};
+  printf("[] State Buffer Allocation (Rerecord, New State Per Step):\n");
+  printf("[]   %-18s   %24s   %12s   %10s   %10s   %10s   %s\n", "Allocator", "Performance (inputs / s)", "System Allocs", "Acquires", "Reused", "RSS (KB)", "Final State Hash");
+  for (size_t allocator = 0; allocator < 4; allocator++)
+  {
+    auto poolInstance = createTestInstance(test);
+    std::unique_ptr<jaffar::StatePool> statePool;
+    if (allocator > 0) statePool = std::make_unique<jaffar::StatePool>(storedStateSize, 64, allocator == 2, allocator == 3);
+
+    const auto poolResult = runAndCheck(test, *poolInstance, poolCycleConfiguration, allocatorNames[allocator], statePool.get());
+
+    // Without the pool, every acquire is a system allocation
+    auto poolStatistics = jaffar::StatePool::statistics_t{poolResult.systemAllocationCount, 0, 0, 0, 0};
+    if (statePool != nullptr) poolStatistics = statePool->getStatistics();
+
+  printf("[]   %-18s   %24.3f   %12lu   %10lu   %10lu   %10lu   %s\n",
+         allocatorNames[allocator],
+         (double)sequenceLength / poolResult.elapsedTimeSeconds,
+         poolResult.systemAllocationCount + poolStatistics.systemAllocationCount,
+         poolStatistics.acquireCount,
+         poolStatistics.reuseCount,
+         jaffar::getResidentSetSize() / 1024,
+         getHashString(poolResult.finalHash).c_str());
+  }
+}
+
+// Measures creating further instances of the ROM. Only the first instance read the ROM and probed its state layout
+void runStartupBenchmark(const testRun_t &test, libA2600Hawk::EmuInstance &e, const double firstStartupSeconds)
+{
+  const auto coreCount0 = e.getSharedCoreCount();
+  std::vector<std::unique_ptr<libA2600Hawk::EmuInstance>> startupInstances;
+  const auto rss0 = jaffar::getResidentSetSize();
+  const auto tu0 = jaffarCommon::timing::now();
+  for (size_t i = 0; i < _CLONE_BENCHMARK_INSTANCES; i++) startupInstances.push_back(createTestInstance(test));
+  const auto tu1 = jaffarCommon::timing::now();
+  const auto rss1 = jaffar::getResidentSetSize();
+
+  // They all start in the same state, and must reproduce the test run
+  for (size_t i = 1; i < _CLONE_BENCHMARK_INSTANCES; i++)
+    if (startupInstances[i]->getStateHash() != startupInstances[0]->getStateHash()) JAFFAR_THROW_RUNTIME("Initial state hash of instance %lu differs from the first one\n", i);
+  runAndCheck(test, *startupInstances.back(), test.cycleConfiguration, "Further Instance");
+
+  const auto registryStatistics = jaffar::RomRegistry::get().getStatistics();
+  printf("[] First Instance Startup Time:            %.3f ms\n", firstStartupSeconds * 1.0e3);
+  printf("[] Further Instance Startup Time:          %.3f ms (%d instances)\n", jaffarCommon::timing::timeDeltaSeconds(tu1, tu0) * 1.0e3 / (double)_CLONE_BENCHMARK_INSTANCES, _CLONE_BENCHMARK_INSTANCES);
+  printf("[] Further Instance Memory:                %.3f KB / instance\n", ((double)rss1 - (double)rss0) / 1024.0 / (double)_CLONE_BENCHMARK_INSTANCES);
+  printf("[] Further Instance Cores Reused:          %lu\n", _CLONE_BENCHMARK_INSTANCES - (e.getSharedCoreCount() - coreCount0));
+  printf("[] ROM Registry:                           %lu lookups, %lu file reads, %lu images (%lu bytes)\n", registryStatistics.lookupCount, registryStatistics.fileReadCount, registryStatistics.imageCount, registryStatistics.imageBytes);
+}
+
+// Compares cloning the tested instance against creating a new one and loading its state
+void runCloneBenchmark(const testRun_t &test, libA2600Hawk::EmuInstance &e)
+{
+  const auto &decodedSequence = test.decodedSequence;
+  const auto stateSize = test.cycleConfiguration.stateSize;
+
+  std::vector<uint8_t> finalState(stateSize);
+  {
+    jaffarCommon::serializer::Contiguous s(finalState.data(), stateSize);
+    e.serializeState(s);
+  }
+
+  // Clones go first, so that they cannot reuse memory freed by the new instances
+  std::vector<std::unique_ptr<libA2600Hawk::EmuInstanceBase>> clones;
+  const auto cloneCores0 = e.getSharedCoreCount();
+  const auto cloneRss0 = jaffar::getResidentSetSize();
+  const auto tc0 = jaffarCommon::timing::now();
+  for (size_t i = 0; i < _CLONE_BENCHMARK_INSTANCES; i++) clones.push_back(e.clone());
+  const auto tc1 = jaffarCommon::timing::now();
+  const auto cloneRss1 = jaffar::getResidentSetSize();
+  const auto cloneCores1 = e.getSharedCoreCount();
+
+  std::vector<std::unique_ptr<libA2600Hawk::EmuInstance>> newInstances;
+  const auto newRss0 = jaffar::getResidentSetSize();
+  const auto tn0 = jaffarCommon::timing::now();
+  for (size_t i = 0; i < _CLONE_BENCHMARK_INSTANCES; i++)
+  {
+    newInstances.push_back(createEmuInstance(test.configJs, test.romFilePath, "", test.stateDisabledBlocks, test.stateHashMode));
+    jaffarCommon::deserializer::Contiguous d(finalState.data(), stateSize);
+    newInstances.back()->deserializeState(d);
+  }
+  const auto tn1 = jaffarCommon::timing::now();
+  const auto newRss1 = jaffar::getResidentSetSize();
+  const auto newCores1 = e.getSharedCoreCount();
+
+  // Every instance must be in the same state, and stay so after advancing the same input
+  const auto finalHash = e.getStateHash();
+  for (size_t i = 0; i < _CLONE_BENCHMARK_INSTANCES; i++)
+  {
+    if (clones[i]->getStateHash() != finalHash) JAFFAR_THROW_RUNTIME("State hash of clone %lu differs from its source\n", i);
+    if (newInstances[i]->getStateHash() != finalHash) JAFFAR_THROW_RUNTIME("State hash of new instance %lu differs from the test run\n", i);
+  }
+  if (decodedSequence.empty() == false)
+  {
+    clones[0]->advanceState(decodedSequence[0]);
+    newInstances[0]->advanceState(decodedSequence[0]);
+    if (clones[0]->getStateHash() != newInstances[0]->getStateHash()) JAFFAR_THROW_RUNTIME("Clone and new instance differ after advancing the same input\n");
+  }
+  newInstances.clear();
+
+  // With the clones destroyed, their cores are recycled by the next ones
+  clones.clear();
+  const auto recycledCores0 = e.getSharedCoreCount();
+  const auto tr0 = jaffarCommon::timing::now();
+  for (size_t i = 0; i < _CLONE_BENCHMARK_CYCLES; i++) { const auto clone = e.clone(); }
+  const auto tr1 = jaffarCommon::timing::now();
+
+  const double cloneSeconds = jaffarCommon::timing::timeDeltaSeconds(tc1, tc0);
+  const double newSeconds = jaffarCommon::timing::timeDeltaSeconds(tn1, tn0);
+  const double recycledSeconds = jaffarCommon::timing::timeDeltaSeconds(tr1, tr0);
+  printf("[] Instance Creation (%d Live Instances, Idle Cores Are Reused):\n", _CLONE_BENCHMARK_INSTANCES);
+  printf("[]   %-24s   %24s   %24s   %13s\n", "Method", "Performance (inst. / s)", "Memory (KB / instance)", "Cores Created");
+  printf("[]   %-24s   %24.3f   %24.3f   %13lu\n", "New Instance", (double)_CLONE_BENCHMARK_INSTANCES / newSeconds, ((double)newRss1 - (double)newRss0) / 1024.0 / (double)_CLONE_BENCHMARK_INSTANCES, newCores1 - cloneCores1);
+  printf("[]   %-24s   %24.3f   %24.3f   %13lu\n", "Clone", (double)_CLONE_BENCHMARK_INSTANCES / cloneSeconds, ((double)cloneRss1 - (double)cloneRss0) / 1024.0 / (double)_CLONE_BENCHMARK_INSTANCES, cloneCores1 - cloneCores0);
+  printf("[]   %-24s   %24.3f   %24s   %13lu\n", "Clone + Destroy", (double)_CLONE_BENCHMARK_CYCLES / recycledSeconds, "-", e.getSharedCoreCount() - recycledCores0);
+}
+
+// Measures the batch engine on the tested instance. Lane i advances the state before test step (i modulo the sequence length) with its input
+void runBatchEngineBenchmark(const testRun_t &test, libA2600Hawk::EmuInstance &e, const int threadCount)
+{
+  const auto &decodedSequence = test.decodedSequence;
+  const auto sequenceLength = decodedSequence.size();
+  const auto stateSize = test.cycleConfiguration.stateSize;
+
+  // Getting the state before each step, and the hash after it
+  auto stepInstance = createTestInstance(test);
+  std::vector<uint8_t> stepStates(sequenceLength * stateSize);
+  std::vector<jaffarCommon::hash::hash_t> stepHashes(sequenceLength);
+  for (size_t i = 0; i < sequenceLength; i++)
+  {
+    jaffarCommon::serializer::Contiguous s(&stepStates[i * stateSize], stateSize);
+    stepInstance->serializeState(s);
+    stepInstance->advanceState(decodedSequence[i]);
+    stepHashes[i] = stepInstance->getStateHash();
+  }
+  if (stepHashes.back() != test.finalHash) JAFFAR_THROW_RUNTIME("Final state hash of the step by step run differs from the test run\n");
+
+  std::vector<uint8_t> states(_BATCH_BENCHMARK_LANES * stateSize);
+  std::vector<jaffar::input_t> inputs(_BATCH_BENCHMARK_LANES);
+  for (size_t lane = 0; lane < _BATCH_BENCHMARK_LANES; lane++)
+  {
+    memcpy(&states[lane * stateSize], &stepStates[(lane % sequenceLength) * stateSize], stateSize);
+    inputs[lane] = decodedSequence[lane % sequenceLength];
+  }
+  std::vector<uint8_t> successors(_BATCH_BENCHMARK_LANES * stateSize);
+  std::vector<jaffarCommon::hash::hash_t> hashes(_BATCH_BENCHMARK_LANES);
+
+  // Every successor must have the hash of its step
+  const auto checkHashes = [&](const char *name) {
+    for (size_t lane = 0; lane < _BATCH_BENCHMARK_LANES; lane++)
+      if (hashes[lane] != stepHashes[lane % sequenceLength]) JAFFAR_THROW_RUNTIME("%s: state hash of lane %lu differs from its test step\n", name, lane);
+  };
+
+  // Advancing one state at a time through a single instance, as a reference
+  const auto tb0 = jaffarCommon::timing::now();
+  for (size_t lane = 0; lane < _BATCH_BENCHMARK_LANES; lane++)
+  {
+    jaffarCommon::deserializer::Contiguous d(&states[lane * stateSize], stateSize);
+    e.deserializeState(d);
+    e.advanceState(inputs[lane]);
+    jaffarCommon::serializer::Contiguous s(&successors[lane * stateSize], stateSize);
+    e.serializeState(s);
+    hashes[lane] = e.getStateHash();
+  }
+  const auto tb1 = jaffarCommon::timing::now();
+  checkHashes("One At A Time");
+  const double referenceSeconds = jaffarCommon::timing::timeDeltaSeconds(tb1, tb0);
+
+  // Restoring the final state of the test run
+  {
+    jaffarCommon::deserializer::Contiguous d(&successors[(sequenceLength - 1) * stateSize], stateSize);
+    e.deserializeState(d);
+  }
+
+  jaffar::BatchEngine batchEngine(e, threadCount);
+  printf("[] Batch Engine (%d Threads, %d Lanes Per Batch Size):\n", threadCount, _BATCH_BENCHMARK_LANES);
+  printf("[]   %-16s   %24s   %8s\n", "Batch Size", "Performance (lanes / s)", "Speedup");
+  printf("[]   %-16s   %24.3f   %7.2fx\n", "One At A Time", (double)_BATCH_BENCHMARK_LANES / referenceSeconds, 1.0);
+  for (const size_t batchSize : {1, 16, 256, 4096})
+  {
+    std::fill(hashes.begin(), hashes.end(), jaffarCommon::hash::hash_t());
+    const auto tb2 = jaffarCommon::timing::now();
+    for (size_t lane = 0; lane < _BATCH_BENCHMARK_LANES; lane += batchSize)
+      batchEngine.advance(&states[lane * stateSize], &inputs[lane], std::min(batchSize, _BATCH_BENCHMARK_LANES - lane), &successors[lane * stateSize], &hashes[lane]);
+    const auto tb3 = jaffarCommon::timing::now();
+
+    const auto batchSizeString = std::to_string(batchSize);
+    checkHashes(batchSizeString.c_str());
+    const double batchSeconds = jaffarCommon::timing::timeDeltaSeconds(tb3, tb2);
+  printf("[]   %-16s   %24.3f   %7.2fx\n", batchSizeString.c_str(), (double)_BATCH_BENCHMARK_LANES / batchSeconds, referenceSeconds / batchSeconds);
+  }
+}
+
+// Measures state size and Rerecord performance for each state block configuration
+void runStateBlockBenchmark(const testRun_t &test, libA2600Hawk::EmuInstance &e)
+{
+  const auto sequenceLength = test.decodedSequence.size();
+
+  // Trying with no blocks disabled, each block disabled on its own, and all of them disabled
+  const auto stateBlockNames = e.getStateBlockNames();
+  std::vector<std::vector<std::string>> blockConfigurations;
+  blockConfigurations.push_back({});
+  for (const auto &block : stateBlockNames) blockConfigurations.push_back({block});
+  if (stateBlockNames.size() > 1) blockConfigurations.push_back(stateBlockNames);
+
+  printf("[] State Block Configurations (Rerecord):\n");
+  printf("[]   %-32s   %10s   %24s   %s\n", "Disabled Blocks", "State Size", "Performance (inputs / s)", "Final State Hash");
+  for (const auto &disabledBlocks : blockConfigurations)
+  {
+    auto blockInstance = createEmuInstance(test.configJs, test.romFilePath, test.initialStateFilePath, disabledBlocks, test.stateHashMode);
+
+    std::string disabledBlocksString = "[ ";
+    for (const auto &block : disabledBlocks) disabledBlocksString += block + std::string(" ");
+    disabledBlocksString += "]";
+
+    auto blockCycleConfiguration = getRerecordConfiguration(test.cycleConfiguration);
+    blockCycleConfiguration.stateSize = blockInstance->getStateSize();
+    blockCycleConfiguration.differentialCompressionEnabled = false;
+    const auto blockResult = runAndCheck(test, *blockInstance, blockCycleConfiguration, disabledBlocksString);
+
+  printf("[]   %-32s   %10lu   %24.3f   %s\n",
+         disabledBlocksString.c_str(),
+         blockCycleConfiguration.stateSize,
+         (double)sequenceLength / blockResult.elapsedTimeSeconds,
+         getHashString(blockResult.finalHash).c_str());
+  }
+}
+
+// Measures the differential state size and Rerecord performance for each way of encoding the state. The encoding must not change the emulation
+void runDifferentialBenchmark(const testRun_t &test)
+{
+  const auto sequenceLength = test.decodedSequence.size();
+
+  printf("[] Differential Encodings (Rerecord, Zlib: %s):\n", test.cycleConfiguration.differentialCompressionUseZlib ? "true" : "false");
+  printf("[]   %-16s   %10s   %13s   %24s   %s\n", "Encoding", "Fixed Size", "Max Size Det.", "Performance (inputs / s)", "Final State Hash");
+  for (const auto &encoding : differentialEncodings)
+  {
+    auto diffInstance = createTestInstance(test);
+    diffInstance->setDifferentialMode(encoding.first);
+
+    // Sized as the test configures it. The differential state size already covers the framing of each diffed segment
+    auto diffCycleConfiguration = getRerecordConfiguration(test.cycleConfiguration);
+    diffCycleConfiguration.differentialCompressionEnabled = true;
+    diffCycleConfiguration.fullDifferentialStateSize = diffInstance->getDifferentialStateSize() + test.differentialCompressionMaxDifferences;
+    const auto diffResult = runAndCheck(test, *diffInstance, diffCycleConfiguration, encoding.second);
+
+  printf("[]   %-16s   %10lu   %13lu   %24.3f   %s\n",
+         encoding.second.c_str(),
+         diffInstance->getDifferentialStateSize(),
+         diffResult.differentialStateMaxSizeDetected,
+         (double)sequenceLength / diffResult.elapsedTimeSeconds,
+         getHashString(diffResult.finalHash).c_str());
+  }
+}
+
+// Measures performance with each advance mode. Game logic must not depend on the output produced
+void runAdvanceModeBenchmark(const testRun_t &test)
+{
+  const auto sequenceLength = test.decodedSequence.size();
+
+  const std::vector<std::pair<libA2600Hawk::EmuInstance::advanceMode_t, std::string>> advanceModes = {
+    {libA2600Hawk::EmuInstance::fast, "Fast"},
+    {libA2600Hawk::EmuInstance::video, "Video"},
+    {libA2600Hawk::EmuInstance::videoAndAudio, "Video + Audio"}};
+
+  printf("[] Advance Modes (%s):\n", test.cycleType.c_str());
+  printf("[]   %-16s   %24s   %s\n", "Mode", "Performance (inputs / s)", "Final State Hash");
+  for (const auto &advanceMode : advanceModes)
+  {
+    auto modeInstance = createTestInstance(test);
+    modeInstance->initializeHeadlessVideoOutput();
+    modeInstance->setAdvanceMode(advanceMode.first);
+    const auto modeResult = runAndCheck(test, *modeInstance, test.cycleConfiguration, advanceMode.second);
+    modeInstance->finalizeVideoOutput();
+
+  printf("[]   %-16s   %24.3f   %s\n", advanceMode.second.c_str(), (double)sequenceLength / modeResult.elapsedTimeSeconds, getHashString(modeResult.finalHash).c_str());
+  }
+}
+
+// Compares advancing frame by frame against the batched advance API, with and without per-frame hashes
+void runBatchedAdvanceBenchmark(const testRun_t &test, const int batchSize)
+{
+  const auto &decodedSequence = test.decodedSequence;
+  const auto sequenceLength = decodedSequence.size();
+
+  std::vector<jaffarCommon::hash::hash_t> frameHashes(sequenceLength);
+  std::vector<jaffarCommon::hash::hash_t> batchHashes(sequenceLength);
+  const char *runNames[4] = {"Per-Frame", "Batched", "Per-Frame + Hashes", "Batched + Hashes"};
+  double runSeconds[4];
+
+  for (size_t run = 0; run < 4; run++)
+  {
+    const bool isBatched = run % 2 == 1;
+    const bool doHash = run >= 2;
+    auto batchInstance = createTestInstance(test);
+
+    auto tb0 = std::chrono::high_resolution_clock::now();
+    if (isBatched == false)
+      for (size_t i = 0; i < sequenceLength; i++)
+      {
+        batchInstance->advanceState(decodedSequence[i]);
+        if (doHash == true) frameHashes[i] = batchInstance->getStateHash();
+      }
+
+    if (isBatched == true)
+      for (size_t start = 0; start < sequenceLength; start += batchSize)
+        batchInstance->advanceStates(&decodedSequence[start], std::min((size_t)batchSize, sequenceLength - start), doHash ? &batchHashes[start] : nullptr);
+    auto tb1 = std::chrono::high_resolution_clock::now();
+    runSeconds[run] = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tb1 - tb0).count() * 1.0e-9;
+
+    if (batchInstance->getStateHash() != test.finalHash) JAFFAR_THROW_RUNTIME("Final state hash of the '%s' run differs from the test run\n", runNames[run]);
+  }
+
+  // Per-frame hashes must match as well
+  for (size_t i = 0; i < sequenceLength; i++)
+    if (batchHashes[i] != frameHashes[i]) JAFFAR_THROW_RUNTIME("Batched advance hash differs from the per-frame one at input %lu\n", i);
+
+  printf("[] Batched Advance (Batch Size: %d):\n", batchSize);
+  for (size_t run = 0; run < 4; run++)
+  printf("[]   + %-20s                %.3f inputs / s\n", runNames[run], (double)sequenceLength / runSeconds[run]);
+  printf("[] Batched Advance Speedup:                %.3fx (%.3fx with hashes)\n", runSeconds[0] / runSeconds[1], runSeconds[2] / runSeconds[3]);
+}
+
+// Renders the sequence without a window and captures its frames, measuring the cost of rendering and of the capture itself
+void runFrameCapture(const testRun_t &test, const std::string &captureFramesPath, const jaffar::FrameWriter::format_t captureFormat, const std::string &captureFormatString)
+{
+  const auto &decodedSequence = test.decodedSequence;
+  const auto sequenceLength = decodedSequence.size();
+
+  auto captureInstance = createTestInstance(test);
+  auto &c = *captureInstance;
+  c.initializeHeadlessVideoOutput();
+  c.enableRendering();
+
+  std::vector<uint8_t> initialState(c.getStateSize());
+  {
+    jaffarCommon::serializer::Contiguous s(initialState.data(), initialState.size());
+    c.serializeState(s);
+  }
+
+  // Emulation and rendering only
+  auto tv0 = std::chrono::high_resolution_clock::now();
+  for (const auto &input : decodedSequence) c.advanceState(input);
+  auto tv1 = std::chrono::high_resolution_clock::now();
+
+  // Emulation, rendering and capture, from the same initial state
+  {
+    jaffarCommon::deserializer::Contiguous d(initialState.data(), initialState.size());
+    c.deserializeState(d);
+  }
+  jaffar::FrameWriter frameWriter(captureFramesPath, c.getVideoBufferWidth(), c.getVideoBufferHeight(), captureFormat);
+  auto tv2 = std::chrono::high_resolution_clock::now();
+  for (const auto &input : decodedSequence)
+  {
+    c.advanceState(input);
+    frameWriter.push((const uint32_t *)c.getVideoBuffer());
+  }
+  auto tv3 = std::chrono::high_resolution_clock::now();
+  frameWriter.finish();
+  auto tv4 = std::chrono::high_resolution_clock::now();
+
+  const double renderSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tv1 - tv0).count() * 1.0e-9;
+  const double captureSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tv3 - tv2).count() * 1.0e-9;
+  const double drainSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tv4 - tv3).count() * 1.0e-9;
+  printf("[] Frame Capture Output:                   '%s' (%s, %lux%lu)\n", captureFramesPath.c_str(), captureFormatString.c_str(), c.getVideoBufferWidth(), c.getVideoBufferHeight());
+  printf("[] Frames Captured:                        %lu (%.3f MB)\n", frameWriter.getFrameCount(), (double)frameWriter.getBytesWritten() / (1024.0 * 1024.0));
+  printf("[] Performance (Emulation Only):           %.3f frames / s\n", (double)sequenceLength / renderSeconds);
+  printf("[] Performance (Emulation + Capture):      %.3f frames / s\n", (double)sequenceLength / captureSeconds);
+  printf("[] Capture Stalls:                         %lu (writer drain time: %3.3fms)\n", frameWriter.getStallCount(), drainSeconds * 1.0e3);
+
+  c.finalizeVideoOutput();
+}
+
+// Records the latency of each step for every cycle type, and reports the tail. An empty sequence has no steps to analyze
+void runLatencyAnalysis(const testRun_t &test, const jaffar::InputParser &inputParser, const int worstStepCount)
+{
+  const auto &decodedSequence = test.decodedSequence;
+  const auto sequenceLength = decodedSequence.size();
+  if (sequenceLength == 0) { printf("[] Step Latency:                           skipped, the sequence is empty\n"); return; }
+
+  jaffar::LatencyRing latencyRing(std::min(sequenceLength, (size_t)_LATENCY_RING_CAPACITY));
+  if (sequenceLength > _LATENCY_RING_CAPACITY) printf("[] Latency ring holds only the last %d steps\n", _LATENCY_RING_CAPACITY);
+
+  for (const auto &latencyCycleType : {std::string("Simple"), std::string("Rerecord")})
+  {
+    auto latencyInstance = createTestInstance(test);
+
+    auto latencyCycleConfiguration = test.cycleConfiguration;
+    latencyCycleConfiguration.doPreAdvance = latencyCycleType == "Rerecord";
+    latencyCycleConfiguration.doDeserialize = latencyCycleType == "Rerecord";
+    latencyCycleConfiguration.doSerialize = latencyCycleType == "Rerecord";
+
+    latencyRing.clear();
+    runSequence(*latencyInstance, decodedSequence, latencyCycleConfiguration, nullptr, &latencyRing);
+
+  printf("[] Step Latency (%s):\n", latencyCycleType.c_str());
+  printf("[]   p50 / p90 / p99 / p99.9 / max:        %.3f / %.3f / %.3f / %.3f / %.3f us\n",
+         (double)latencyRing.getPercentile(0.50) * 1.0e-3,
+         (double)latencyRing.getPercentile(0.90) * 1.0e-3,
+         (double)latencyRing.getPercentile(0.99) * 1.0e-3,
+         (double)latencyRing.getPercentile(0.999) * 1.0e-3,
+         (double)latencyRing.getMax() * 1.0e-3);
+  printf("[]   Worst Steps:\n");
+    for (const auto &entry : latencyRing.getWorst(worstStepCount))
+  printf("[]     Step %8lu: %10.3f us   %s\n", entry.stepId, (double)entry.latency * 1.0e-3, inputParser.getInputString(decodedSequence[entry.stepId]).c_str());
+  }
+}
+
+// Measures the aggregate throughput of independent instances running in parallel, on 1 up to the given number of threads
+void runParallelBenchmark(const testRun_t &test, const int threadCount)
+{
+  const auto &decodedSequence = test.decodedSequence;
+  const auto sequenceLength = decodedSequence.size();
+  const auto stateSize = test.cycleConfiguration.stateSize;
+
+  // Creating one emulator instance per thread
+  std::vector<std::unique_ptr<libA2600Hawk::EmuInstance>> instances;
+  for (int i = 0; i < threadCount; i++) instances.push_back(createTestInstance(test));
+
+  // All threads start from the same initial state
+  std::vector<uint8_t> initialState(stateSize);
+  {
+    jaffarCommon::serializer::Contiguous s(initialState.data(), stateSize);
+    instances[0]->serializeState(s);
+  }
+
+  // Running with 1, 2, 4, ... up to the requested number of threads
+  std::vector<size_t> threadCounts;
+  for (size_t t = 1; t < (size_t)threadCount; t *= 2) threadCounts.push_back(t);
+  threadCounts.push_back(threadCount);
+
+  std::vector<double> aggregatePerformance;
+  std::vector<runResult_t> threadResults;
+  for (const auto t : threadCounts)
+  {
+    auto wallTime = runParallel(instances, t, initialState, decodedSequence, test.cycleConfiguration, threadResults);
+    aggregatePerformance.push_back((double)(sequenceLength * t) / wallTime);
+
+    // All threads must reach the same final state as the single instance run
+    for (size_t i = 0; i < t; i++)
+      if (threadResults[i].finalHash != test.finalHash)
+        JAFFAR_THROW_RUNTIME("Thread %lu/%lu final state hash 0x%lX%lX differs from the expected 0x%lX%lX\n",
+                             i, t, threadResults[i].finalHash.first, threadResults[i].finalHash.second, test.finalHash.first, test.finalHash.second);
+  }
+
+  // Printing per-thread information for the largest run
+  printf("[] Parallel Run Threads:                   %d\n", threadCount);
+  for (size_t i = 0; i < threadResults.size(); i++)
+  printf("[]   + Thread %3lu:                         %.3f inputs / s\n", i, (double)sequenceLength / threadResults[i].elapsedTimeSeconds);
+
+  // Printing scaling table
+  printf("[] Scaling Efficiency:\n");
+  printf("[]   Threads   Aggregate (inputs / s)   Speedup   Efficiency\n");
+  for (size_t i = 0; i < threadCounts.size(); i++)
+  {
+    const auto speedup = aggregatePerformance[i] / aggregatePerformance[0];
+  printf("[]   %7lu   %22.3f   %7.3fx   %9.2f%%\n", threadCounts[i], aggregatePerformance[i], speedup, 100.0 * speedup / (double)threadCounts[i]);
+  }
+  printf("[] Parallel Final State Hashes:            All match\n");
+}
 
 int main(int argc, char *argv[])
 {
@@ -26,13 +848,18 @@ int main(int argc, char *argv[])
     .required();
 
   program.add_argument("sequenceFile")
-    .help("Path to the input sequence file (.sol) to reproduce.")
+    .help("Path to the input sequence file (.sol or binary movie) to reproduce.")
     .required();
 
   program.add_argument("--cycleType")
-    .help("Specifies the emulation actions to be performed per each input. Possible values: 'Simple': performs only advance state, 'Rerecord': performs load/advance/save, and 'Full': performs load/advance/save/advance.")
+    .help("Specifies the emulation actions to be performed per each input. Possible values: 'Simple': performs only advance state, 'Rerecord': performs load/advance/save, 'Full': performs load/advance/save/advance, and 'Lockstep': runs Simple and Rerecord side by side, stopping at the first step where they diverge.")
     .default_value(std::string("Simple"));
 
+  program.add_argument("--lockstepInterval")
+    .help("Number of steps between state hash comparisons in the 'Lockstep' cycle type. A mismatch is narrowed down to the first divergent step by replaying from the last match")
+    .default_value(1)
+    .scan<'i', int>();
+
   program.add_argument("--hashOutputFile")
     .help("Path to write the hash output to.")
     .default_value(std::string(""));
@@ -42,6 +869,100 @@ int main(int argc, char *argv[])
   .default_value(false)
   .implicit_value(true);
 
+  program.add_argument("--stateHash")
+    .help("State hash to compute. Possible values: 'metro': MetroHash128 of the whole work RAM, 'zobrist': incremental Zobrist hash of the work RAM, 'zobristChecked': incremental Zobrist hash, checked against a full recomputation at every hash")
+    .default_value(std::string("metro"));
+
+  program.add_argument("--benchmarkHash")
+  .help("Measures state hashing throughput, comparing a hash update per RAM byte against a single update over a RAM copy (both read the RAM one byte per core call), and the per-step cost of each state hash")
+  .default_value(false)
+  .implicit_value(true);
+
+  program.add_argument("--benchmarkParser")
+  .help("Measures input parsing throughput, comparing the reference parser against the fast and batch parsers")
+  .default_value(false)
+  .implicit_value(true);
+
+  program.add_argument("--transitionCache")
+  .help("Memoizes frame advances in a transition cache with the given budget in megabytes (0: disabled), and measures its costs")
+  .default_value(0)
+  .scan<'i', int>();
+
+  program.add_argument("--benchmarkStateBlocks")
+  .help("Measures state size and Rerecord performance with each of the core's state blocks disabled")
+  .default_value(false)
+  .implicit_value(true);
+
+  program.add_argument("--benchmarkStateSize")
+  .help("Measures the cost of probing the state size through the core against the cached size, next to the Rerecord cycle and the state block toggles that used to probe it")
+  .default_value(false)
+  .implicit_value(true);
+
+  program.add_argument("--benchmarkStatePool")
+  .help("Measures a Rerecord cycle that stores each step's state in a new buffer, allocating it with malloc or from the state pool (plain, with huge pages, and with every page faulted in when its chunk is allocated)")
+  .default_value(false)
+  .implicit_value(true);
+
+  program.add_argument("--benchmarkStartup")
+  .help("Measures the startup time and memory of further instances of the same ROM, which share its image, state layout and idle cores")
+  .default_value(false)
+  .implicit_value(true);
+
+  program.add_argument("--benchmarkClone")
+  .help("Measures creating live instances in the test's final state by cloning against creating new ones (instances / s and memory per instance), and the clone / destroy cycle")
+  .default_value(false)
+  .implicit_value(true);
+
+  program.add_argument("--benchmarkBatchEngine")
+  .help("Measures the batch engine advancing independent states (one per test step) by one frame with different batch sizes, on the number of threads given by --threads, against advancing them one at a time")
+  .default_value(false)
+  .implicit_value(true);
+
+  program.add_argument("--benchmarkDifferential")
+  .help("Measures the differential state size and Rerecord performance with the raw, generic diff and mutable region state encodings")
+  .default_value(false)
+  .implicit_value(true);
+
+  program.add_argument("--benchmarkAdvanceModes")
+  .help("Measures performance with each frame advance mode (fast, video, video and audio) and checks that all reach the same final state")
+  .default_value(false)
+  .implicit_value(true);
+
+  program.add_argument("--batchSize")
+  .help("Also runs the sequence (Simple cycle) through the batched advance API, in batches of the given number of frames, and compares it against advancing frame by frame (0: disabled)")
+  .default_value(0)
+  .scan<'i', int>();
+
+  program.add_argument("--captureFrames")
+  .help("Renders the sequence headlessly (no SDL) and streams its frames to the given file, named pipe or '|command', reporting emulation performance with and without capture")
+  .default_value(std::string(""));
+
+  program.add_argument("--captureFormat")
+  .help("Format of the captured frames: 'raw' (ARGB8888, no header) or 'delta' (XOR delta against the previous frame)")
+  .default_value(std::string("raw"));
+
+  program.add_argument("--differentialCompression")
+  .help("Overrides the script's differential compression setting. Possible values: 'script': use the script's setting, 'disabled', 'enabled': without zlib, 'zlib': with zlib")
+  .default_value(std::string("script"));
+
+  program.add_argument("--differentialEncoding")
+  .help("Overrides the script's differential state encoding. Possible values: 'script': use the script's setting, 'Raw State', 'Generic Diff', 'Mutable Regions'")
+  .default_value(std::string("script"));
+
+  program.add_argument("--worstSteps")
+  .help("Records the latency of every step with each cycle type, and reports its percentiles and the given number of most expensive steps with their inputs (0: disabled)")
+  .default_value(0)
+  .scan<'i', int>();
+
+  program.add_argument("--phaseReport")
+  .help("Path to save a JSON report of the test run, including the per-phase timing breakdown (requires building with -DphaseTiming=true)")
+  .default_value(std::string(""));
+
+  program.add_argument("--threads")
+  .help("Also runs the sequence on 1 up to the given number of threads, each with its own emulator instance, and reports the scaling efficiency")
+  .default_value(1)
+  .scan<'i', int>();
+
   // Try to parse arguments
   try { program.parse_args(argc, argv); } catch (const std::runtime_error &err) { JAFFAR_THROW_LOGIC("%s\n%s", err.what(), program.help().str().c_str()); }
 
@@ -57,17 +978,107 @@ int main(int argc, char *argv[])
   bool cycleTypeRecognized = false;
   if (cycleType == "Simple") cycleTypeRecognized = true;
   if (cycleType == "Rerecord") cycleTypeRecognized = true;
+  if (cycleType == "Lockstep") cycleTypeRecognized = true;
   if (cycleTypeRecognized == false) JAFFAR_THROW_LOGIC("Unrecognized cycle type: %s\n", cycleType.c_str());
 
+  // Getting the hash comparison interval for the lockstep cycle
+  const auto lockstepInterval = program.get<int>("--lockstepInterval");
+  if (lockstepInterval < 1) JAFFAR_THROW_LOGIC("Invalid lockstep interval: %d\n", lockstepInterval);
+
+  // Getting state hash mode
+  const auto stateHashString = program.get<std::string>("--stateHash");
+  bool stateHashRecognized = false;
+  if (stateHashString == "metro") stateHashRecognized = true;
+  if (stateHashString == "zobrist") stateHashRecognized = true;
+  if (stateHashString == "zobristChecked") stateHashRecognized = true;
+  if (stateHashRecognized == false) JAFFAR_THROW_LOGIC("Unrecognized state hash: %s\n", stateHashString.c_str());
+  auto stateHashMode = libA2600Hawk::EmuInstance::metroHash;
+  if (stateHashString == "zobrist") stateHashMode = libA2600Hawk::EmuInstance::zobristHash;
+  if (stateHashString == "zobristChecked") stateHashMode = libA2600Hawk::EmuInstance::zobristHashChecked;
+
   // Getting warmup setting
   const auto useWarmUp = program.get<bool>("--warmup");
 
+  // Getting hash benchmark setting
+  const auto benchmarkHash = program.get<bool>("--benchmarkHash");
+
+  // Getting parser benchmark setting
+  const auto benchmarkParser = program.get<bool>("--benchmarkParser");
+
+  // Getting transition cache budget
+  const auto transitionCacheSizeMb = program.get<int>("--transitionCache");
+  if (transitionCacheSizeMb < 0) JAFFAR_THROW_LOGIC("Invalid transition cache size: %d\n", transitionCacheSizeMb);
+
+  // Getting state block benchmark setting
+  const auto benchmarkStateBlocks = program.get<bool>("--benchmarkStateBlocks");
+
+  // Getting state size benchmark setting
+  const auto benchmarkStateSize = program.get<bool>("--benchmarkStateSize");
+
+  // Getting state pool benchmark setting
+  const auto benchmarkStatePool = program.get<bool>("--benchmarkStatePool");
+
+  // Getting startup benchmark setting
+  const auto benchmarkStartup = program.get<bool>("--benchmarkStartup");
+
+  // Getting clone benchmark setting
+  const auto benchmarkClone = program.get<bool>("--benchmarkClone");
+
+  // Getting batch engine benchmark setting
+  const auto benchmarkBatchEngine = program.get<bool>("--benchmarkBatchEngine");
+
+  // Getting differential encoding benchmark setting
+  const auto benchmarkDifferential = program.get<bool>("--benchmarkDifferential");
+
+  // Getting advance mode benchmark setting
+  const auto benchmarkAdvanceModes = program.get<bool>("--benchmarkAdvanceModes");
+
+  // Getting batch size for the batched advance comparison
+  const auto batchSize = program.get<int>("--batchSize");
+  if (batchSize < 0) JAFFAR_THROW_LOGIC("Invalid batch size: %d\n", batchSize);
+
+  // Getting frame capture output and format
+  const auto captureFramesPath = program.get<std::string>("--captureFrames");
+  const auto captureFormatString = program.get<std::string>("--captureFormat");
+  bool captureFormatRecognized = false;
+  if (captureFormatString == "raw") captureFormatRecognized = true;
+  if (captureFormatString == "delta") captureFormatRecognized = true;
+  if (captureFormatRecognized == false) JAFFAR_THROW_LOGIC("Unrecognized capture format: %s\n", captureFormatString.c_str());
+  const auto captureFormat = captureFormatString == "raw" ? jaffar::FrameWriter::raw : jaffar::FrameWriter::delta;
+
+  // Getting differential compression override
+  const auto differentialCompressionOverride = program.get<std::string>("--differentialCompression");
+  bool differentialCompressionOverrideRecognized = false;
+  if (differentialCompressionOverride == "script") differentialCompressionOverrideRecognized = true;
+  if (differentialCompressionOverride == "disabled") differentialCompressionOverrideRecognized = true;
+  if (differentialCompressionOverride == "enabled") differentialCompressionOverrideRecognized = true;
+  if (differentialCompressionOverride == "zlib") differentialCompressionOverrideRecognized = true;
+  if (differentialCompressionOverrideRecognized == false) JAFFAR_THROW_LOGIC("Unrecognized differential compression setting: %s\n", differentialCompressionOverride.c_str());
+
+  // Getting differential encoding override, and checking it names a known encoding
+  const auto differentialEncodingOverride = program.get<std::string>("--differentialEncoding");
+  if (differentialEncodingOverride != "script") getDifferentialEncoding(differentialEncodingOverride);
+
+  // Getting number of worst steps to report in the latency analysis
+  const auto worstStepCount = program.get<int>("--worstSteps");
+  if (worstStepCount < 0) JAFFAR_THROW_LOGIC("Invalid worst step count: %d\n", worstStepCount);
+
+  // Getting phase timing report path
+  const auto phaseReportFile = program.get<std::string>("--phaseReport");
+#ifndef _PHASE_TIMING
+  if (phaseReportFile != "") JAFFAR_THROW_LOGIC("A phase report was requested, but phase timing is not compiled in (configure with -DphaseTiming=true)\n");
+#endif
+
+  // Getting maximum number of threads for the parallel run
+  const auto threadCount = program.get<int>("--threads");
+  if (threadCount < 1) JAFFAR_THROW_LOGIC("Invalid thread count: %d\n", threadCount);
+
   // Loading script file
   std::string configJsRaw;
   if (jaffarCommon::file::loadStringFromFile(configJsRaw, scriptFilePath) == false) JAFFAR_THROW_LOGIC("Could not find/read script file: %s\n", scriptFilePath.c_str());
 
   // Parsing script
-  const auto configJs = nlohmann::json::parse(configJsRaw);
+  auto configJs = nlohmann::json::parse(configJsRaw);
 
   // Getting rom file path
   const auto romFilePath = jaffarCommon::json::getString(configJs, "Rom File");
@@ -99,7 +1110,7 @@ int main(int argc, char *argv[])
 
   if (differentialCompressionJs.contains("Enabled") == false) JAFFAR_THROW_LOGIC("Script file missing 'Differential Compression / Enabled' entry\n");
   if (differentialCompressionJs["Enabled"].is_boolean() == false) JAFFAR_THROW_LOGIC("Script file 'Differential Compression / Enabled' entry is not a boolean\n");
-  const auto differentialCompressionEnabled = differentialCompressionJs["Enabled"].get<bool>();
+  auto differentialCompressionEnabled = differentialCompressionJs["Enabled"].get<bool>();
 
   if (differentialCompressionJs.contains("Max Differences") == false) JAFFAR_THROW_LOGIC("Script file missing 'Differential Compression / Max Differences' entry\n");
   if (differentialCompressionJs["Max Differences"].is_number() == false) JAFFAR_THROW_LOGIC("Script file 'Differential Compression / Max Differences' entry is not a number\n");
@@ -107,36 +1118,27 @@ int main(int argc, char *argv[])
 
   if (differentialCompressionJs.contains("Use Zlib") == false) JAFFAR_THROW_LOGIC("Script file missing 'Differential Compression / Use Zlib' entry\n");
   if (differentialCompressionJs["Use Zlib"].is_boolean() == false) JAFFAR_THROW_LOGIC("Script file 'Differential Compression / Use Zlib' entry is not a boolean\n");
-  const auto differentialCompressionUseZlib = differentialCompressionJs["Use Zlib"].get<bool>();
+  auto differentialCompressionUseZlib = differentialCompressionJs["Use Zlib"].get<bool>();
 
-  // Creating emulator instance
-  auto e = libA2600Hawk::EmuInstance(configJs);
+  // Applying the command line override, if any
+  if (differentialCompressionOverride != "script")
+  {
+    differentialCompressionEnabled = differentialCompressionOverride != "disabled";
+    differentialCompressionUseZlib = differentialCompressionOverride == "zlib";
+  }
 
-  // Initializing emulator instance
-  e.initialize();
+  // Applying the encoding override to the script, so that every instance created from it uses the same encoding
+  if (differentialEncodingOverride != "script") configJs["Differential Compression"]["Encoding"] = differentialEncodingOverride;
+  const auto differentialEncodingName = getDifferentialEncodingName(configJs);
 
-  // Disable rendering
-  e.disableRendering();
-  
-  // Loading ROM File
-  std::string romFileData;
-  if (jaffarCommon::file::loadStringFromFile(romFileData, romFilePath) == false) JAFFAR_THROW_LOGIC("Could not rom file: %s\n", romFilePath.c_str());
-  e.loadROM(romFilePath);
+  // Loading ROM File, and checking it against the expected SHA1 hash. The emulator instances get it from the registry too
+  const auto romSHA1 = jaffar::RomRegistry::get().load(romFilePath, expectedROMSHA1)->sha1;
 
-  // Calculating ROM SHA1
-  auto romSHA1 = jaffarCommon::hash::getSHA1String(romFileData);
-
-  // If an initial state is provided, load it now
-  if (initialStateFilePath != "")
-  {
-    std::string stateFileData;
-    if (jaffarCommon::file::loadStringFromFile(stateFileData, initialStateFilePath) == false) JAFFAR_THROW_LOGIC("Could not initial state file: %s\n", initialStateFilePath.c_str());
-    jaffarCommon::deserializer::Contiguous d(stateFileData.data());
-    e.deserializeState(d);
-  }
-  
-  // Disabling requested blocks from state serialization
-  for (const auto& block : stateDisabledBlocks) e.disableStateBlock(block);
+  // Creating emulator instance, loading the ROM, the initial state, and disabling the requested state blocks
+  const auto ts0 = jaffarCommon::timing::now();
+  auto emuInstance = createEmuInstance(configJs, romFilePath, initialStateFilePath, stateDisabledBlocks, stateHashMode);
+  const auto ts1 = jaffarCommon::timing::now();
+  auto &e = *emuInstance;
 
   // Getting full state size
   const auto stateSize = e.getStateSize();
@@ -145,25 +1147,43 @@ int main(int argc, char *argv[])
   const auto fixedDiferentialStateSize = e.getDifferentialStateSize();
   const auto fullDifferentialStateSize = fixedDiferentialStateSize + differentialCompressionMaxDifferences;
 
-  // Checking with the expected SHA1 hash
-  if (romSHA1 != expectedROMSHA1) JAFFAR_THROW_LOGIC("Wrong ROM SHA1. Found: '%s', Expected: '%s'\n", romSHA1.c_str(), expectedROMSHA1.c_str());
+  // Getting input parser from the emulator
+  const auto inputParser = e.getInputParser();
 
-  // Loading sequence file
-  std::string sequenceRaw;
-  if (jaffarCommon::file::loadStringFromFile(sequenceRaw, sequenceFilePath) == false) JAFFAR_THROW_LOGIC("[ERROR] Could not find or read from input sequence file: %s\n", sequenceFilePath.c_str());
+  // Recording how the test runs, so that the benchmarks can create instances like the tested one and check their runs against it
+  testRun_t test;
+  test.configJs = configJs;
+  test.romFilePath = romFilePath;
+  test.initialStateFilePath = initialStateFilePath;
+  test.stateDisabledBlocks = stateDisabledBlocks;
+  test.stateHashMode = stateHashMode;
+  test.cycleType = cycleType;
+  test.differentialCompressionMaxDifferences = differentialCompressionMaxDifferences;
 
-  // Building sequence information
-  const auto sequence = jaffarCommon::string::split(sequenceRaw, ' ');
+  // Getting decoded emulator input for each entry in the sequence
+  auto &decodedSequence = test.decodedSequence;
+  const bool isBinaryMovie = jaffar::MovieFile::isMovieFile(sequenceFilePath);
+  auto tl0 = std::chrono::high_resolution_clock::now();
 
-  // Getting sequence lenght
-  const auto sequenceLength = sequence.size();
+  // Binary movies are memory-mapped and unpacked directly, without any parsing
+  if (isBinaryMovie == true)
+  {
+    jaffar::MovieFile movieFile(sequenceFilePath);
+    movieFile.decode(decodedSequence);
+  }
 
-  // Getting input parser from the emulator
-  const auto inputParser = e.getInputParser();
+  // Text sequences are split and each input string is parsed
+  if (isBinaryMovie == false)
+  {
+    std::string sequenceRaw;
+    if (jaffarCommon::file::loadStringFromFile(sequenceRaw, sequenceFilePath) == false) JAFFAR_THROW_LOGIC("[ERROR] Could not find or read from input sequence file: %s\n", sequenceFilePath.c_str());
+    inputParser->parseInputSequence(sequenceRaw, decodedSequence);
+  }
+  auto tl1 = std::chrono::high_resolution_clock::now();
+  const double sequenceLoadTimeSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(tl1 - tl0).count() * 1.0e-9;
 
-  // Getting decoded emulator input for each entry in the sequence
-  std::vector<jaffar::input_t> decodedSequence;
-  for (const auto &inputString : sequence) decodedSequence.push_back(inputParser->parseInputString(inputString));
+  // Getting sequence lenght
+  const auto sequenceLength = decodedSequence.size();
 
   // Getting emulation core name
   std::string emulationCoreName = e.getCoreName();
@@ -172,18 +1192,26 @@ int main(int argc, char *argv[])
   printf("[] -----------------------------------------\n");
   printf("[] Running Script:                         '%s'\n", scriptFilePath.c_str());
   printf("[] Cycle Type:                             '%s'\n", cycleType.c_str());
+  if (cycleType == "Lockstep")
+  {
+  printf("[]   + Hash Comparison Interval:           %d steps\n", lockstepInterval);
+  }
   printf("[] Emulation Core:                         '%s'\n", emulationCoreName.c_str());
   printf("[] ROM File:                               '%s'\n", romFilePath.c_str());
   printf("[] Controller Types:                       '%s' / '%s'\n", controller1Type.c_str(), controller2Type.c_str());
   printf("[] ROM Hash:                               'SHA1: %s'\n", romSHA1.c_str());
   printf("[] Sequence File:                          '%s'\n", sequenceFilePath.c_str());
   printf("[] Sequence Length:                        %lu\n", sequenceLength);
+  printf("[] Sequence Format:                        %s\n", isBinaryMovie ? "Binary Movie" : "Text");
+  printf("[] Sequence Load Time:                     %3.3fms\n", sequenceLoadTimeSeconds * 1.0e3);
   printf("[] State Size:                             %lu bytes - Disabled Blocks:  [ %s ]\n", stateSize, stateDisabledBlocksOutput.c_str());
+  printf("[] State Hash:                             '%s'\n", stateHashString.c_str());
   printf("[] Use Differential Compression:           %s\n", differentialCompressionEnabled ? "true" : "false");
   if (differentialCompressionEnabled == true) 
   { 
   printf("[]   + Max Differences:                    %lu\n", differentialCompressionMaxDifferences);    
   printf("[]   + Use Zlib:                           %s\n", differentialCompressionUseZlib ? "true" : "false");
+  printf("[]   + Encoding:                           %s\n", differentialEncodingName.c_str());
   printf("[]   + Fixed Diff State Size:              %lu\n", fixedDiferentialStateSize);
   printf("[]   + Full Diff State Size:               %lu\n", fullDifferentialStateSize);
   }
@@ -199,97 +1227,128 @@ int main(int argc, char *argv[])
     while(waitedTime < 2.0) waitedTime = jaffarCommon::timing::timeDeltaSeconds(jaffarCommon::timing::now(), tw);
   }
 
-  printf("[] ********** Running Test **********\n");
+  // The lockstep cycle runs Rerecord on a second instance, next to the main one running Simple
+  std::unique_ptr<libA2600Hawk::EmuInstance> rerecordInstance;
+  if (cycleType == "Lockstep") rerecordInstance = createEmuInstance(configJs, romFilePath, initialStateFilePath, stateDisabledBlocks, stateHashMode);
 
-  fflush(stdout);
+  // Enabling transition cache, if requested
+  if (transitionCacheSizeMb > 0) e.enableTransitionCache((size_t)transitionCacheSizeMb * 1024 * 1024);
+  if (transitionCacheSizeMb > 0 && rerecordInstance != nullptr) rerecordInstance->enableTransitionCache((size_t)transitionCacheSizeMb * 1024 * 1024);
 
-  // Serializing initial state
-  auto currentState = (uint8_t *)malloc(stateSize);
-  {
-    jaffarCommon::serializer::Contiguous cs(currentState);
-    e.serializeState(cs);
-  }
+  printf("[] ********** Running Test **********\n");
 
-  // Serializing differential state data (in case it's used)
-  uint8_t *differentialStateData = nullptr;
-  size_t differentialStateMaxSizeDetected = 0;
+  fflush(stdout);
 
-  // Allocating memory for differential data and performing the first serialization
-  if (differentialCompressionEnabled == true) 
-  {
-    differentialStateData = (uint8_t *)malloc(fullDifferentialStateSize);
-    auto s = jaffarCommon::serializer::Differential(differentialStateData, fullDifferentialStateSize, currentState, stateSize, differentialCompressionUseZlib);
-    e.serializeState(s);
-    differentialStateMaxSizeDetected = s.getOutputSize();
-  }
+  // Configuring the emulation cycle
+  cycleConfiguration_t cycleConfiguration;
+  cycleConfiguration.doPreAdvance = cycleType == "Rerecord";
+  cycleConfiguration.doDeserialize = cycleType == "Rerecord";
+  cycleConfiguration.doSerialize = cycleType == "Rerecord";
+  cycleConfiguration.stateSize = stateSize;
+  cycleConfiguration.differentialCompressionEnabled = differentialCompressionEnabled;
+  cycleConfiguration.differentialCompressionUseZlib = differentialCompressionUseZlib;
+  cycleConfiguration.fullDifferentialStateSize = fullDifferentialStateSize;
+  cycleConfiguration.newStatePerStep = false;
+  test.cycleConfiguration = cycleConfiguration;
 
-  // Check whether to perform each action
-  bool doPreAdvance = cycleType == "Rerecord";
-  bool doDeserialize = cycleType == "Rerecord";
-  bool doSerialize = cycleType == "Rerecord";
+  // Actually running the sequence. Timing builds record up to two advances per step (pre-advance and advance), and Lockstep
+  // records the Simple cycle's advance on top of those, so the busiest phase gets 3 samples per step
+  jaffar::PhaseTimer *phaseTimerPtr = nullptr;
+#ifdef _PHASE_TIMING
+  jaffar::PhaseTimer phaseTimer(sequenceLength * (cycleType == "Lockstep" ? 3 : 2));
+  phaseTimerPtr = &phaseTimer;
+#endif
+  const auto rerecordCycleConfiguration = getRerecordConfiguration(cycleConfiguration);
 
-  // Actually running the sequence
-  auto t0 = std::chrono::high_resolution_clock::now();
-  for (const auto &input : decodedSequence)
+  // The stored states come from a state pool, as in the search engines
+  jaffar::StatePool cycleStatePool(differentialCompressionEnabled ? fullDifferentialStateSize : stateSize);
+  const auto runResult = cycleType == "Lockstep" ? runLockstep(e, *rerecordInstance, decodedSequence, cycleConfiguration, rerecordCycleConfiguration, lockstepInterval, phaseTimerPtr, &cycleStatePool)
+                                                 : runSequence(e, decodedSequence, cycleConfiguration, phaseTimerPtr, nullptr, &cycleStatePool);
+  if (runResult.divergenceReport != "")
   {
-    if (doPreAdvance == true) e.advanceState(input);
-    
-    if (doDeserialize == true)
-    {
-      if (differentialCompressionEnabled == true) 
-      {
-       jaffarCommon::deserializer::Differential d(differentialStateData, fullDifferentialStateSize, currentState, stateSize, differentialCompressionUseZlib);
-       e.deserializeState(d);
-      }
-
-      if (differentialCompressionEnabled == false)
-      {
-        jaffarCommon::deserializer::Contiguous d(currentState, stateSize);
-        e.deserializeState(d);
-      } 
-    } 
-    
-    e.advanceState(input);
-
-    if (doSerialize == true)
-    {
-      if (differentialCompressionEnabled == true)
-      {
-        auto s = jaffarCommon::serializer::Differential(differentialStateData, fullDifferentialStateSize, currentState, stateSize, differentialCompressionUseZlib);
-        e.serializeState(s);
-        differentialStateMaxSizeDetected = std::max(differentialStateMaxSizeDetected, s.getOutputSize());
-      }  
-
-      if (differentialCompressionEnabled == false) 
-      {
-        auto s = jaffarCommon::serializer::Contiguous(currentState, stateSize);
-        e.serializeState(s);
-      }
-    } 
+    printf("%s", runResult.divergenceReport.c_str());
+    fflush(stdout);
+    JAFFAR_THROW_RUNTIME("Simple and Rerecord cycles diverged\n");
   }
-  auto tf = std::chrono::high_resolution_clock::now();
-
-  // Calculating running time
-  auto dt = std::chrono::duration_cast<std::chrono::nanoseconds>(tf - t0).count();
-  double elapsedTimeSeconds = (double)dt * 1.0e-9;
-
-  // Calculating final state hash
-  auto result = e.getStateHash();
+  const auto elapsedTimeSeconds = runResult.elapsedTimeSeconds;
+  const auto differentialStateMaxSizeDetected = runResult.differentialStateMaxSizeDetected;
+  const auto result = runResult.finalHash;
+  test.finalHash = result;
 
   // Creating hash string
-  char hashStringBuffer[256];
-  sprintf(hashStringBuffer, "0x%lX%lX", result.first, result.second);
+  const auto hashString = getHashString(result);
 
   // Printing time information
-  printf("[] Elapsed time:                           %3.3fs\n", (double)dt * 1.0e-9);
+  printf("[] Elapsed time:                           %3.3fs\n", elapsedTimeSeconds);
   printf("[] Performance:                            %.3f inputs / s\n", (double)sequenceLength / elapsedTimeSeconds);
-  printf("[] Final State Hash:                       %s\n", hashStringBuffer);
+  printf("[] Final State Hash:                       %s\n", hashString.c_str());
   if (differentialCompressionEnabled == true)
   {
   printf("[] Differential State Max Size Detected:   %lu\n", differentialStateMaxSizeDetected);    
   }
+  if (cycleType == "Lockstep")
+  {
+  printf("[] Simple and Rerecord States:             Match at every compared step\n");
+  }
+
+#ifdef _PHASE_TIMING
+  // Printing the time spent on each phase of the cycle
+  printf("[] Phase Breakdown (Hash is timed outside the elapsed time):\n");
+  printf("[]   %-12s   %10s   %9s   %7s   %10s   %10s   %10s   %10s   %10s\n", "Phase", "Count", "Total (s)", "Share", "Mean (ns)", "p50 (ns)", "p90 (ns)", "p99 (ns)", "Max (ns)");
+  for (size_t phase = 0; phase < jaffar::PhaseTimer::phaseCount; phase++)
+  {
+    const auto summary = phaseTimer.getSummary((jaffar::PhaseTimer::phase_t)phase);
+    if (summary.count == 0) continue;
+  printf("[]   %-12s   %10lu   %9.3f   %6.2f%%   %10lu   %10lu   %10lu   %10lu   %10lu\n",
+         jaffar::PhaseTimer::getPhaseName((jaffar::PhaseTimer::phase_t)phase),
+         summary.count,
+         summary.totalSeconds,
+         100.0 * summary.totalSeconds / elapsedTimeSeconds,
+         summary.mean,
+         summary.p50,
+         summary.p90,
+         summary.p99,
+         summary.max);
+  }
+
+  // Saving the machine-readable report
+  if (phaseReportFile != "")
+  {
+    nlohmann::json reportJs;
+    reportJs["Script"] = scriptFilePath;
+    reportJs["Cycle Type"] = cycleType;
+    reportJs["Sequence Length"] = sequenceLength;
+    reportJs["State Size"] = stateSize;
+    reportJs["Differential Compression"] = differentialCompressionEnabled;
+    reportJs["Differential Encoding"] = differentialEncodingName;
+    reportJs["Elapsed Seconds"] = elapsedTimeSeconds;
+    reportJs["Inputs Per Second"] = (double)sequenceLength / elapsedTimeSeconds;
+    reportJs["Final State Hash"] = hashString;
+    reportJs["Phases"] = phaseTimer.getReport();
+    if (jaffarCommon::file::saveStringToFile(reportJs.dump(2), phaseReportFile.c_str()) == false) JAFFAR_THROW_LOGIC("Could not write phase report file: %s\n", phaseReportFile.c_str());
+  }
+#endif
+
+
+  // Running the requested benchmarks, each against the final state of the test run
+  if (benchmarkHash == true) runHashBenchmark(test, e);
+  if (transitionCacheSizeMb > 0) reportTransitionCache(test, e, (size_t)transitionCacheSizeMb * 1024 * 1024);
+  if (benchmarkParser == true) runParserBenchmark(test, *inputParser);
+  if (benchmarkStateSize == true) runStateSizeBenchmark(test, e);
+  if (benchmarkStatePool == true) runStatePoolBenchmark(test);
+  if (benchmarkStartup == true) runStartupBenchmark(test, e, jaffarCommon::timing::timeDeltaSeconds(ts1, ts0));
+  if (benchmarkClone == true) runCloneBenchmark(test, e);
+  if (benchmarkBatchEngine == true && sequenceLength > 0) runBatchEngineBenchmark(test, e, threadCount);
+  if (benchmarkStateBlocks == true) runStateBlockBenchmark(test, e);
+  if (benchmarkDifferential == true) runDifferentialBenchmark(test);
+  if (benchmarkAdvanceModes == true) runAdvanceModeBenchmark(test);
+  if (batchSize > 0) runBatchedAdvanceBenchmark(test, batchSize);
+  if (captureFramesPath != "") runFrameCapture(test, captureFramesPath, captureFormat, captureFormatString);
+  if (worstStepCount > 0) runLatencyAnalysis(test, *inputParser, worstStepCount);
+  if (threadCount > 1) runParallelBenchmark(test, threadCount);
+
   // If saving hash, do it now
-  if (hashOutputFile != "") jaffarCommon::file::saveStringToFile(std::string(hashStringBuffer), hashOutputFile.c_str());
+  if (hashOutputFile != "") jaffarCommon::file::saveStringToFile(hashString, hashOutputFile.c_str());
 
   // If reached this point, everything ran ok
   return 0;
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <jaffarCommon/hash.hpp>
+#include "inputParser.hpp"
+
+namespace libA2600Hawk
+{
+
+// Memoizes frame advances. Maps the hash of a full serialized state plus an input
+// to the state that results from advancing it, within a fixed memory budget.
+// When the budget is exhausted, the least recently used transition is evicted.
+// The budget covers each entry's bookkeeping (map node, bucket and LRU list node) as well as its state.
+class TransitionCache
+{
+  public:
+
+  TransitionCache(const size_t maxBytes, const size_t stateSize)
+    : _stateSize(stateSize)
+    , _entryBytes(getEntryBytes(stateSize))
+    , _capacity(maxBytes / _entryBytes)
+  {
+    if (_capacity == 0) JAFFAR_THROW_LOGIC("Transition cache budget (%lu bytes) is smaller than a single entry (%lu bytes)\n", maxBytes, _entryBytes);
+
+    // Allocating the buckets up front, so the bucket array does not grow past what the budget accounts for
+    _entries.reserve(_capacity);
+  }
+
+  // Estimates the memory taken by one cached transition: the state buffer, the map node (key, entry, next
+  // pointer and cached hash), its bucket pointer and the LRU list node (key and two pointers). Each heap
+  // block also pays for its allocator header
+  static inline size_t getEntryBytes(const size_t stateSize)
+  {
+    const size_t stateBytes = stateSize + _ALLOCATION_OVERHEAD;
+    const size_t mapNodeBytes = sizeof(jaffarCommon::hash::hash_t) + sizeof(entry_t) + 2 * sizeof(void *) + _ALLOCATION_OVERHEAD;
+    const size_t bucketBytes = sizeof(void *);
+    const size_t listNodeBytes = sizeof(jaffarCommon::hash::hash_t) + 2 * sizeof(void *) + _ALLOCATION_OVERHEAD;
+    return stateBytes + mapNodeBytes + bucketBytes + listNodeBytes;
+  }
+
+  // Computes the key of a transition
+  static inline jaffarCommon::hash::hash_t getKey(const uint8_t *state, const size_t stateSize, const jaffar::input_t &input)
+  {
+    MetroHash128 hash;
+    hash.Update(state, stateSize);
+
+    const uint8_t console = (uint8_t)((input.reset ? 1 : 0) | (input.select ? 2 : 0) | (input.power ? 4 : 0) | (input.leftDifficulty ? 8 : 0) | (input.rightDifficulty ? 16 : 0));
+    hash.Update(console);
+    hash.Update(input.port1);
+    hash.Update(input.port2);
+
+    jaffarCommon::hash::hash_t result;
+    hash.Finalize(reinterpret_cast<uint8_t *>(&result));
+    return result;
+  }
+
+  // Returns the resulting state of the transition, or nullptr if not cached
+  inline const uint8_t *lookup(const jaffarCommon::hash::hash_t &key)
+  {
+    _lookups++;
+
+    auto entry = _entries.find(key);
+    if (entry == _entries.end()) return nullptr;
+
+    _hits++;
+    _lruList.splice(_lruList.begin(), _lruList, entry->second.lruPosition);
+    return entry->second.state.data();
+  }
+
+  // Stores the resulting state of a transition, evicting the least recently used one if full
+  inline void insert(const jaffarCommon::hash::hash_t &key, const uint8_t *state)
+  {
+    if (_entries.find(key) != _entries.end()) return;
+
+    std::vector<uint8_t> stateData;
+    if (_entries.size() >= _capacity)
+    {
+      const auto evictedKey = _lruList.back();
+      stateData = std::move(_entries[evictedKey].state);
+      _entries.erase(evictedKey);
+      _lruList.pop_back();
+      _evictions++;
+    }
+    stateData.assign(state, state + _stateSize);
+
+    _lruList.push_front(key);
+    auto &newEntry = _entries[key];
+    newEntry.state = std::move(stateData);
+    newEntry.lruPosition = _lruList.begin();
+  }
+
+  size_t getEntryCount() const { return _entries.size(); }
+  size_t getCapacity() const { return _capacity; }
+  size_t getEntryBytes() const { return _entryBytes; }
+  size_t getUsedBytes() const { return _entries.size() * _entryBytes; }
+  size_t getLookupCount() const { return _lookups; }
+  size_t getHitCount() const { return _hits; }
+  size_t getEvictionCount() const { return _evictions; }
+  double getHitRate() const { return _lookups == 0 ? 0.0 : (double)_hits / (double)_lookups; }
+
+  private:
+
+  struct keyHasher_t
+  {
+    inline size_t operator()(const jaffarCommon::hash::hash_t &key) const { return key.first ^ key.second; }
+  };
+
+  struct entry_t
+  {
+    std::vector<uint8_t> state;
+    std::list<jaffarCommon::hash::hash_t>::iterator lruPosition;
+  };
+
+  // Bytes taken by the allocator header of each heap block
+  static constexpr size_t _ALLOCATION_OVERHEAD = 16;
+
+  // Size of each stored state
+  const size_t _stateSize;
+
+  // Estimated memory taken by each entry, state included
+  const size_t _entryBytes;
+
+  // Maximum number of transitions that fit in the memory budget
+  const size_t _capacity;
+
+  // Cached transitions, most recently used first
+  std::unordered_map<jaffarCommon::hash::hash_t, entry_t, keyHasher_t> _entries;
+  std::list<jaffarCommon::hash::hash_t> _lruList;
+
+  // Statistics
+  size_t _lookups = 0;
+  size_t _hits = 0;
+  size_t _evictions = 0;
+};
+
+} // namespace libA2600Hawk
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <jaffarCommon/exceptions.hpp>
+
+namespace jaffar
+{
+
+// Per-worker work queues. Each worker takes items from the back of its own queue, so it keeps working on what it was given
+// (and on whatever it has cached for it), and only when that runs out steals from the front of the others' queues,
+// starting from its neighbour so that thieves spread out over different victims
+template <class T>
+class WorkStealingPool
+{
+  public:
+
+  WorkStealingPool(const size_t workerCount) : _queues(workerCount)
+  {
+    if (workerCount == 0) JAFFAR_THROW_LOGIC("The work stealing pool needs at least one worker\n");
+  }
+
+  void push(const size_t workerId, T item)
+  {
+    auto &queue = _queues[workerId];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.items.push_back(std::move(item));
+  }
+
+  // Gets the next item for the given worker. Returns false once every queue is empty
+  bool pop(const size_t workerId, T &item)
+  {
+    // Taking from the own queue first
+    {
+      auto &queue = _queues[workerId];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.items.empty() == false)
+      {
+        item = std::move(queue.items.back());
+        queue.items.pop_back();
+        return true;
+      }
+    }
+
+    // Otherwise, stealing the oldest item of another worker
+    for (size_t i = 1; i < _queues.size(); i++)
+    {
+      auto &queue = _queues[(workerId + i) % _queues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.items.empty() == false)
+      {
+        item = std::move(queue.items.front());
+        queue.items.pop_front();
+        _stealCount++;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  size_t getWorkerCount() const { return _queues.size(); }
+  size_t getStealCount() const { return _stealCount; }
+
+  private:
+
+  struct queue_t
+  {
+    std::mutex mutex;
+    std::deque<T> items;
+  };
+
+  std::vector<queue_t> _queues;
+  std::atomic<size_t> _stealCount{0};
+};
+
+} // namespace jaffar
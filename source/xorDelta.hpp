@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// XOR delta encoding shared by the state store and the frame writer. The difference between two arrays of
+// elements is encoded as a sequence of (equal elements to skip, differing elements count, XORed elements)
+// runs, with varint-encoded counts. Applying a delta in place turns the previous array into the current one
+namespace jaffar
+{
+
+namespace xorDelta
+{
+
+inline void pushVarint(std::vector<uint8_t> &output, size_t value)
+{
+  while (value >= 0x80)
+  {
+    output.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  output.push_back((uint8_t)value);
+}
+
+inline size_t popVarint(const uint8_t *&input)
+{
+  size_t value = 0;
+  size_t shift = 0;
+  while (*input & 0x80)
+  {
+    value |= (size_t)(*input++ & 0x7F) << shift;
+    shift += 7;
+  }
+  value |= (size_t)(*input++) << shift;
+  return value;
+}
+
+// Appends the delta between two arrays of count elements to the output
+template <typename T>
+inline void encode(const T *previous, const T *current, const size_t count, std::vector<uint8_t> &output)
+{
+  size_t pos = 0;
+  while (pos < count)
+  {
+    const size_t skipStart = pos;
+    while (pos < count && previous[pos] == current[pos]) pos++;
+    if (pos == count) break;
+
+    const size_t runStart = pos;
+    while (pos < count && previous[pos] != current[pos]) pos++;
+
+    pushVarint(output, runStart - skipStart);
+    pushVarint(output, pos - runStart);
+    for (size_t i = runStart; i < pos; i++)
+    {
+      const T element = previous[i] ^ current[i];
+      const auto elementBytes = (const uint8_t *)&element;
+      output.insert(output.end(), elementBytes, elementBytes + sizeof(T));
+    }
+  }
+}
+
+// Applies an encoded delta in place
+template <typename T>
+inline void apply(const uint8_t *delta, const size_t deltaSize, T *data)
+{
+  const uint8_t *input = delta;
+  const uint8_t *end = input + deltaSize;
+  size_t pos = 0;
+  while (input < end)
+  {
+    pos += popVarint(input);
+    const size_t runLength = popVarint(input);
+    for (size_t i = 0; i < runLength; i++)
+    {
+      T element;
+      memcpy(&element, input, sizeof(T));
+      data[pos++] ^= element;
+      input += sizeof(T);
+    }
+  }
+}
+
+} // namespace xorDelta
+
+} // namespace jaffar
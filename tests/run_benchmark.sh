@@ -0,0 +1,135 @@
+#!/bin/bash
+
+# Runs a test movie with every cycle type (and, for Rerecord, every differential compression setting),
+# and compares the median performance of each configuration against a stored baseline.
+#
+# Usage: run_benchmark.sh <tester> <test name> <repetitions> <tolerance %> <baseline folder> <output folder>
+#
+# Environment:
+#  BENCHMARK_CPU:             CPU core to pin the tester to (default: 0)
+#  BENCHMARK_UPDATE_BASELINE: if set to 1, the results become the new baseline
+#
+# If there is no baseline for the test yet (and none is being recorded), the benchmark is skipped (exit code 77)
+# before running anything.
+
+# Stop if anything fails
+set -e
+
+# Getting arguments
+executable=${1}
+testName=${2}
+repetitions=${3}
+tolerance=${4}
+baselineFolder=${5}
+outputFolder=${6}
+
+script=${testName}.test
+sequence=${testName}.sol
+resultFile=${outputFolder}/${testName}.benchmark.json
+baselineFile=${baselineFolder}/${testName}.json
+
+# Without a baseline there is nothing to compare against
+if [ "${BENCHMARK_UPDATE_BASELINE}" != "1" ] && [ ! -f ${baselineFile} ]; then
+ echo "[] No baseline for ${testName} in ${baselineFolder}. Run with BENCHMARK_UPDATE_BASELINE=1 to record one"
+ exit 77
+fi
+
+# Pinning to a single core, if possible, to reduce variation
+cpu=${BENCHMARK_CPU:-0}
+pinCommand=""
+if command -v taskset > /dev/null; then pinCommand="taskset -c ${cpu}"; fi
+
+cycleTypes="Simple Rerecord"
+
+# Differential compression only applies to cycles that serialize the state, so Simple runs without it
+compressionSettingsFor()
+{
+  if [ "${1}" = "Rerecord" ]; then echo "disabled enabled zlib"; else echo "disabled"; fi
+}
+
+# Warming up the CPU only once, before the first run
+warmupArg="--warmup"
+
+# Runs the tester once and prints its performance (inputs / s)
+runOnce()
+{
+  ${pinCommand} ${executable} ${script} ${sequence} --cycleType ${1} --differentialCompression ${2} ${warmupArg} | awk '/^\[\] Performance:/ { print $3 }'
+}
+
+# Writing results
+mkdir -p ${outputFolder}
+echo "{" > ${resultFile}
+echo "  \"Test\": \"${testName}\"," >> ${resultFile}
+echo "  \"Repetitions\": ${repetitions}," >> ${resultFile}
+echo "  \"Results\":" >> ${resultFile}
+echo "  {" >> ${resultFile}
+
+separator=""
+for cycleType in ${cycleTypes}; do
+ for compression in `compressionSettingsFor ${cycleType}`; do
+
+  # The first run is discarded, as it warms up the caches
+  runOnce ${cycleType} ${compression} > /dev/null
+  warmupArg=""
+
+  samples=""
+  for i in `seq 1 ${repetitions}`; do
+   sample=`runOnce ${cycleType} ${compression}`
+   if [ "${sample}" = "" ]; then echo "[] Could not get the performance of ${testName} (${cycleType} / ${compression})"; exit 1; fi
+   samples="${samples} ${sample}"
+  done
+
+  # Getting median, minimum and maximum
+  sorted=`echo ${samples} | tr ' ' '\n' | sort -g`
+  median=`echo "${sorted}" | awk '{ v[NR] = $1 } END { if (NR % 2 == 1) print v[(NR + 1) / 2]; else print (v[NR / 2] + v[NR / 2 + 1]) / 2 }'`
+  min=`echo "${sorted}" | head -n 1`
+  max=`echo "${sorted}" | tail -n 1`
+
+  echo "[] ${testName} ${cycleType} / ${compression}: ${median} inputs / s (min: ${min}, max: ${max})"
+  if [ "${separator}" != "" ]; then echo "${separator}" >> ${resultFile}; fi
+  echo -n "    \"${cycleType} / ${compression}\": { \"Median\": ${median}, \"Min\": ${min}, \"Max\": ${max} }" >> ${resultFile}
+  separator=","
+ done
+done
+
+echo "" >> ${resultFile}
+echo "  }" >> ${resultFile}
+echo "}" >> ${resultFile}
+
+echo "[] Results saved to ${resultFile}"
+
+# Storing as baseline, if requested
+if [ "${BENCHMARK_UPDATE_BASELINE}" = "1" ]; then
+ mkdir -p ${baselineFolder}
+ cp ${resultFile} ${baselineFile}
+ echo "[] Baseline updated: ${baselineFile}"
+ exit 0
+fi
+
+# Comparing each configuration's median against the baseline
+failed=0
+for cycleType in ${cycleTypes}; do
+ for compression in `compressionSettingsFor ${cycleType}`; do
+  key="\"${cycleType} / ${compression}\""
+  current=`grep "${key}" ${resultFile} | sed 's/.*"Median": \([^,]*\),.*/\1/'`
+  baseline=`grep "${key}" ${baselineFile} | sed 's/.*"Median": \([^,]*\),.*/\1/'`
+  if [ "${baseline}" = "" ]; then echo "[] ${cycleType} / ${compression}: no baseline, skipping"; continue; fi
+
+  change=`awk -v c=${current} -v b=${baseline} 'BEGIN { printf "%.2f", 100.0 * (c - b) / b }'`
+  regressed=`awk -v c=${current} -v b=${baseline} -v t=${tolerance} 'BEGIN { print (c < b * (1.0 - t / 100.0)) ? 1 : 0 }'`
+  if [ "${regressed}" = "1" ]; then
+   echo "[] ${cycleType} / ${compression}: ${current} vs baseline ${baseline} (${change}%) -- Regression (tolerance: ${tolerance}%)"
+   failed=1
+  else
+   echo "[] ${cycleType} / ${compression}: ${current} vs baseline ${baseline} (${change}%)"
+  fi
+ done
+done
+
+if [ "${failed}" = "1" ]; then
+ echo "[] Benchmark Failed"
+ exit 1
+fi
+
+echo "[] Benchmark Passed"
+exit 0
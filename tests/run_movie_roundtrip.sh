@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Converts a text input sequence into a binary movie, and checks that the tester reaches the same final state hash with both.
+#
+# Usage: run_movie_roundtrip.sh <tester> <movie converter> <test name> <output folder>
+
+# Stop if anything fails
+set -e
+
+# Getting arguments
+tester=${1}
+converter=${2}
+testName=${3}
+outputFolder=${4}
+
+script=${testName}.test
+sequence=${testName}.sol
+movieFile=${outputFolder}/${testName}.movie
+hashFile=${outputFolder}/${testName}.roundtrip
+
+mkdir -p ${outputFolder}
+rm -f ${movieFile} ${hashFile}.text ${hashFile}.binary
+
+set -x
+# Converting the sequence
+${converter} ${script} ${sequence} ${movieFile}
+
+# Running the text sequence and the binary movie
+${tester} ${script} ${sequence} --hashOutputFile ${hashFile}.text
+${tester} ${script} ${movieFile} --hashOutputFile ${hashFile}.binary
+set +x
+
+# Comparing hashes
+hashText=`cat ${hashFile}.text`
+hashBinary=`cat ${hashFile}.binary`
+rm -f ${movieFile} ${hashFile}.text ${hashFile}.binary
+
+if [ "${hashText}" = "${hashBinary}" ]; then
+ echo "[] Test Passed (${hashText})"
+ exit 0
+else
+ echo "[] Test Failed: text sequence ${hashText}, binary movie ${hashBinary}"
+ exit 1
+fi